@@ -0,0 +1,80 @@
+#ifndef ALLOCATION_CACHE_H
+#define ALLOCATION_CACHE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+#include "riptide_controllers/thrust_allocation.h"
+
+// Quantized allocation inputs: the command, the body-frame up vector (the only
+// part of the attitude the buoyancy term depends on) and the buoyancy flag
+struct AllocationKey
+{
+  int32_t q[10];
+
+  bool operator==(const AllocationKey &other) const
+  {
+    return std::equal(q, q + 10, other.q);
+  }
+};
+
+struct AllocationKeyHash
+{
+  size_t operator()(const AllocationKey &key) const
+  {
+    // FNV-1a over the quantized values
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < 10; i++)
+    {
+      h ^= static_cast<uint32_t>(key.q[i]);
+      h *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(h);
+  }
+};
+
+// Options for the allocation cache
+struct CacheOptions
+{
+  size_t capacity;         // Entries kept, 0 = cache disabled
+  double accel_resolution; // Command quantization [m/s^2, rad/s^2]
+  double tilt_resolution;  // Attitude quantization [rad]
+  double max_ang_v;        // Above this rate [rad/s] the gyroscopic terms matter, so solve instead
+
+  CacheOptions() : capacity(0), accel_resolution(0.01), tilt_resolution(0.01), max_ang_v(0.1) {}
+};
+
+// Least-recently-used cache of thrust solutions.
+// Once full, an insert recycles the oldest entry in place.
+class AllocationCache
+{
+ private:
+  struct Entry
+  {
+    AllocationKey key;
+    ThrustVector thrust;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  typedef std::list<Entry, Eigen::aligned_allocator<Entry> > EntryList;
+
+  CacheOptions options;
+  EntryList entries; // Most recently used first
+  std::unordered_map<AllocationKey, EntryList::iterator, AllocationKeyHash> index;
+
+ public:
+  explicit AllocationCache(const CacheOptions &opts = CacheOptions());
+
+  bool enabled() const { return options.capacity > 0; }
+  size_t size() const { return entries.size(); }
+
+  // False when the state is outside what the cache can represent (spinning)
+  bool makeKey(const Vector6d &cmd, const VehicleState &state, AllocationKey &key) const;
+  bool lookup(const AllocationKey &key, ThrustVector &thrust);
+  void insert(const AllocationKey &key, const ThrustVector &thrust);
+  void clear();
+};
+
+#endif
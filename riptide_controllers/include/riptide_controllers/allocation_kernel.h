@@ -0,0 +1,90 @@
+#ifndef ALLOCATION_KERNEL_H
+#define ALLOCATION_KERNEL_H
+
+#include "riptide_controllers/thrust_allocation.h"
+#include "riptide_controllers/thruster_layout.h"
+
+// Fixed-size kernels unrolled over the thrusters at compile time. The recursion
+// on I is resolved by the compiler, leaving straight-line code with no loops,
+// heap allocation or virtual calls.
+
+// Allocation matrix columns from the generated thruster layout (thruster_layout.h).
+// The positions are compile-time constants, so the cross products fold away.
+template <int I>
+struct LayoutColumns
+{
+  static void fill(const VehicleProperties &p, const bool allocated[NUM_THRUSTERS], AllocationMatrix &A)
+  {
+    typedef LayoutThruster<I> L;
+    if (allocated[I])
+    {
+      A(0, I) = L::dx / p.mass;
+      A(1, I) = L::dy / p.mass;
+      A(2, I) = L::dz / p.mass;
+      A(3, I) = (L::y * L::dz - L::z * L::dy) / p.Ixx;
+      A(4, I) = (L::z * L::dx - L::x * L::dz) / p.Iyy;
+      A(5, I) = (L::x * L::dy - L::y * L::dx) / p.Izz;
+    }
+    else
+    {
+      A.col(I).setZero();
+    }
+    LayoutColumns<I + 1>::fill(p, allocated, A);
+  }
+
+  static void geometry(ThrusterGeometry &g)
+  {
+    typedef LayoutThruster<I> L;
+    // Copied first: Vector3d takes const references, which would ODR-use the
+    // constants, and C++11 has no out-of-class definitions for them
+    const double x = L::x, y = L::y, z = L::z;
+    const double dx = L::dx, dy = L::dy, dz = L::dz;
+    g.position[I] = Eigen::Vector3d(x, y, z);
+    g.direction[I] = Eigen::Vector3d(dx, dy, dz);
+    LayoutColumns<I + 1>::geometry(g);
+  }
+};
+
+template <>
+struct LayoutColumns<NUM_THRUSTERS>
+{
+  static void fill(const VehicleProperties &, const bool[NUM_THRUSTERS], AllocationMatrix &) {}
+  static void geometry(ThrusterGeometry &) {}
+};
+
+inline AllocationMatrix layoutAllocationMatrix(const VehicleProperties &props, const bool allocated[NUM_THRUSTERS])
+{
+  AllocationMatrix A;
+  LayoutColumns<0>::fill(props, allocated, A);
+  return A;
+}
+
+// Thruster geometry as generated, with every thruster allocated
+inline ThrusterGeometry layoutGeometry()
+{
+  ThrusterGeometry g;
+  LayoutColumns<0>::geometry(g);
+  return g;
+}
+
+// A * u for thrusts of any scalar type (e.g. Ceres Jets), one thruster column at a time
+template <int J>
+struct UnrolledProduct
+{
+  template <typename T>
+  static void accumulate(const AllocationMatrix &A, const T *const *u, T *out)
+  {
+    for (int r = 0; r < 6; r++)
+      out[r] += T(A(r, J)) * u[J][0];
+    UnrolledProduct<J + 1>::accumulate(A, u, out);
+  }
+};
+
+template <>
+struct UnrolledProduct<NUM_THRUSTERS>
+{
+  template <typename T>
+  static void accumulate(const AllocationMatrix &, const T *const *, T *) {}
+};
+
+#endif
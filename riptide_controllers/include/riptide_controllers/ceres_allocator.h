@@ -0,0 +1,48 @@
+#ifndef CERES_ALLOCATOR_H
+#define CERES_ALLOCATOR_H
+
+#include "ceres/ceres.h"
+#include "riptide_controllers/thrust_allocation.h"
+
+// Everything the residual functors read. Owned by CeresAllocator and updated
+// before each solve.
+struct AllocationTerms
+{
+  VehicleProperties props;
+  ThrusterGeometry geometry;
+  VehicleState state;
+  Vector6d cmd;
+  Vector6d target; // cmd minus the state accelerations
+  AllocationMatrix A;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Iterative thrust allocation with Ceres (bounded nonlinear least squares).
+// Kept as a reference to validate the closed-form allocator against.
+class CeresAllocator
+{
+ private:
+  AllocationTerms terms;
+  WarmStartOptions warm_start;
+  LastAllocation last;
+  double x[NUM_THRUSTERS];
+  ceres::Problem problem;
+  ceres::Solver::Options options;
+  ceres::Solver::Summary summary;
+
+  void addEquations();
+  void addCachedEquations();
+
+ public:
+  CeresAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+                 const WarmStartOptions &warm = WarmStartOptions());
+  // Holds unallocated thrusters at 0 N, so the solver only works on the others
+  void setAllocated(const bool allocated[NUM_THRUSTERS]);
+  AllocationStats allocate(const Vector6d &cmd, const VehicleState &state, ThrustVector &thrust);
+  const ceres::Solver::Summary &lastSummary() const { return summary; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
@@ -22,6 +22,7 @@ class CommandCombinator
     ros::Publisher cmd_pub;
     geometry_msgs::Accel current_accel;
     void ResetController();
+    void PublishAccel();
 
   public:
     CommandCombinator();
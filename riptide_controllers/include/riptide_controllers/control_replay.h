@@ -0,0 +1,130 @@
+#ifndef CONTROL_REPLAY_H
+#define CONTROL_REPLAY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ros/ros.h"
+#include "tf/transform_listener.h"
+#include "std_msgs/Float64.h"
+#include "geometry_msgs/Vector3.h"
+#include "riptide_msgs/Depth.h"
+#include "riptide_msgs/DepthState.h"
+#include "riptide_msgs/Imu.h"
+#include "riptide_msgs/PwmStamped.h"
+#include "riptide_msgs/SwitchState.h"
+#include "riptide_msgs/ThrusterMask.h"
+#include "riptide_msgs/ThrustStamped.h"
+#include "imu_3dm_gx4/FilterOutput.h"
+#include "imu_3dm_gx4/MagFieldCF.h"
+
+#include "riptide_hardware/flight_log.h"
+#include "riptide_hardware/depth_processor.h"
+#include "riptide_hardware/imu_processor.h"
+#include "riptide_controllers/attitude_controller.h"
+#include "riptide_controllers/command_combinator.h"
+#include "riptide_controllers/depth_controller.h"
+#include "riptide_controllers/pwm_controller.h"
+#include "riptide_controllers/thruster_controller.h"
+
+// Recorded topic to the callbacks it is replayed into
+class ReplayRoute
+{
+public:
+  std::string md5sum;
+  virtual ~ReplayRoute() {}
+  // Deserializes one recorded message and hands it to every callback
+  virtual void deliver(const uint8_t *data, uint32_t length) = 0;
+};
+
+template <class M>
+class TypedReplayRoute : public ReplayRoute
+{
+public:
+  std::vector<boost::function<void(const boost::shared_ptr<M const> &)> > callbacks;
+
+  TypedReplayRoute() { md5sum = ros::message_traits::MD5Sum<M>::value(); }
+  void deliver(const uint8_t *data, uint32_t length)
+  {
+    boost::shared_ptr<M> msg(new M);
+    ros::serialization::IStream stream(const_cast<uint8_t *>(data), length);
+    ros::serialization::deserialize(stream, *msg);
+    for (size_t i = 0; i < callbacks.size(); i++)
+      callbacks[i](msg);
+  }
+};
+
+// The IMU filter and PWM calibration arrays are 32-byte aligned, which plain
+// new does not honour before C++17
+template <class T>
+struct AlignedDelete
+{
+  void operator()(T *p) const
+  {
+    p->~T();
+    free(p);
+  }
+};
+
+template <class T>
+using AlignedPtr = std::unique_ptr<T, AlignedDelete<T> >;
+
+template <class T, class... Args>
+T *alignedNew(Args &&... args)
+{
+  void *p;
+  if (posix_memalign(&p, alignof(T), sizeof(T)) != 0)
+    throw std::bad_alloc();
+  return new (p) T(std::forward<Args>(args)...);
+}
+
+class ControlReplay
+{
+private:
+  ros::NodeHandle nh;
+  ros::Subscriber thrust_sub, pwm_sub;
+  tf::TransformListener listener;
+
+  AlignedPtr<IMUProcessor> imu_processor;
+  AlignedPtr<DepthProcessor> depth_processor;
+  AlignedPtr<DepthController> depth_controller;
+  AlignedPtr<AttitudeController> attitude_controller;
+  AlignedPtr<CommandCombinator> command_combinator;
+  AlignedPtr<ThrusterController> thruster_controller;
+  AlignedPtr<PWMController> pwm_controller;
+
+  std::map<std::string, std::shared_ptr<ReplayRoute> > routes; // By recorded topic name, without the leading /
+  std::vector<ReplayRoute *> topic_routes; // By log topic index, 0 = not replayed
+
+  // PWM controller timers, run in simulated time
+  ros::Time next_output, next_watchdog;
+
+  ros::Time start; // Of the log; CSV times count from here
+  FILE *thrust_csv, *pwm_csv, *recorded_thrust_csv, *recorded_pwm_csv;
+  long inputs, thrust_count, pwm_count;
+
+  template <class M>
+  void route(const std::string &topic, const boost::function<void(const boost::shared_ptr<M const> &)> &callback);
+  void buildRoutes(bool imu_raw, bool depth_raw);
+  ReplayRoute *findRoute(const FlightLogReader &reader, uint16_t topic);
+  void advanceTo(const ros::Time &t);
+  void drain();
+  bool openOutput(const std::string &prefix);
+  void closeOutput();
+
+public:
+  ControlReplay();
+  ~ControlReplay();
+  bool run(char **argv);
+  void thrustCB(const riptide_msgs::ThrustStamped::ConstPtr &thrust);
+  void pwmCB(const riptide_msgs::PwmStamped::ConstPtr &pwm);
+  void recordedThrustCB(const riptide_msgs::ThrustStamped::ConstPtr &thrust);
+  void recordedPwmCB(const riptide_msgs::PwmStamped::ConstPtr &pwm);
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include "control_toolbox/pid.h"
 #include "std_msgs/Float64.h"
 #include "riptide_msgs/Depth.h"
+#include "riptide_msgs/DepthState.h"
 #include "riptide_msgs/SwitchState.h"
 
 class DepthController
@@ -23,9 +24,9 @@ class DepthController
     //PID
     double depth_error;
     double current_depth;
+    double current_velocity;
     double cmd_depth;
     double d_error;
-    double last_error;
     double dt;
 
     bool pid_initialized;
@@ -38,8 +39,9 @@ class DepthController
 
   public:
     DepthController();
-    void CommandCB(const riptide_msgs::Depth::ConstPtr &depth);
-    void DepthCB(const riptide_msgs::Depth::ConstPtr &cmd);
+    DepthController(const ros::NodeHandle &node);
+    void CommandCB(const riptide_msgs::Depth::ConstPtr &cmd);
+    void DepthCB(const riptide_msgs::DepthState::ConstPtr &depth);
     void SwitchCB(const riptide_msgs::SwitchState::ConstPtr &state);
  };
 
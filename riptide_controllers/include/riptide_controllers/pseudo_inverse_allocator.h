@@ -0,0 +1,36 @@
+#ifndef PSEUDO_INVERSE_ALLOCATOR_H
+#define PSEUDO_INVERSE_ALLOCATOR_H
+
+#include "riptide_controllers/thrust_allocation.h"
+
+// Closed-form thrust allocation.
+// The allocation matrix and its weighted pseudo-inverse are computed once. Each
+// command is a single matrix-vector product; thrusters that exceed the limits are
+// clamped and the remaining demand is redistributed over the free thrusters.
+class PseudoInverseAllocator
+{
+ private:
+  VehicleProperties props;
+  ThrusterGeometry geometry;
+  AllocationMatrix A;
+  ThrustVector w_inv; // Inverse thruster weights (higher weight = used less)
+  Eigen::Matrix<double, NUM_THRUSTERS, 6> A_pinv;
+  WarmStartOptions warm_start;
+  LastAllocation last;
+
+  void rebuild();
+  void solveFree(const Vector6d &target, const ThrustVector &free_mask, ThrustVector &thrust) const;
+
+ public:
+  PseudoInverseAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+                         const ThrustVector &weights = ThrustVector::Ones(),
+                         const WarmStartOptions &warm = WarmStartOptions());
+  // Rebuilds A and its pseudo-inverse for the thrusters that are still allocated
+  void setAllocated(const bool allocated[NUM_THRUSTERS]);
+  AllocationStats allocate(const Vector6d &cmd, const VehicleState &state, ThrustVector &thrust);
+  const AllocationMatrix &matrix() const { return A; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
@@ -2,10 +2,38 @@
 #define PWM_CONTROLLER_H
 
 #include "ros/ros.h"
+#include <algorithm>
+#include <vector>
 
 #include "riptide_msgs/PwmStamped.h"
 #include "riptide_msgs/ThrustStamped.h"
 #include "riptide_msgs/SwitchState.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "riptide_controllers/thrust_to_pwm.h"
+
+// Thrust to PWM lookup table from scripts/thrust_calibration.py
+struct ThrustLUT
+{
+  float thrust_min;  // N, thrust of the first entry
+  float thrust_step; // N between entries
+  std::vector<int> pwm; // Empty when no table was loaded
+};
+
+// Watchdog timing, accumulated between diagnostics messages
+struct WatchdogStats
+{
+  long checks;
+  double jitter_sum, jitter_max;   // s, timer callback lateness
+  long trips;
+  double latency_sum, latency_max; // s, from the timeout expiring to the failsafe
+
+  WatchdogStats() { reset(); }
+  void reset()
+  {
+    checks = trips = 0;
+    jitter_sum = jitter_max = latency_sum = latency_max = 0;
+  }
+};
 
 class PWMController
 {
@@ -14,23 +42,51 @@ class PWMController
   ros::Subscriber cmd_sub;
   ros::Subscriber kill_sub;
   ros::Publisher pwm_pub;
+  ros::Publisher diag_pub;
+  ros::Timer output_timer;
+  ros::Timer watchdog_timer;
+  ros::Timer diag_timer;
   riptide_msgs::PwmStamped msg;
   void PublishZeroPWM();
+  void PublishOutput();
+  void SetPWM(const int pwm[NUM_THRUSTERS]);
 
-  int thrust2pwm(double raw_force, int thruster);
+  int lookup(const ThrustLUT &lut, double raw_force);
   void load_calibration(float &param, std::string name);
+  bool load_lut(ThrustLUT &lut, std::string name);
 
-  float thrust_config[8][4]; // thrust slopes
+  PwmCalibration calibration; // thrust slopes
+  ThrustLUT thrust_lut[NUM_THRUSTERS]; // Used instead of the slopes when loaded
+
+  // Output stage, published at output_rate whatever the command rate
+  float target_pwm[NUM_THRUSTERS]; // Latest command, before slew limiting
+  float output_pwm[NUM_THRUSTERS]; // Last published PWM
+  float slew_rate[NUM_THRUSTERS];  // us/s
+  ros::Time target_stamp;
+  double output_rate; // Hz
+  double soft_start;  // s to ramp up to full PWM after the kill switch is inserted
+  ros::Time armed_time;
   bool dead;
   bool silent;
   ros::Time last_alive_time;
   ros::Duration alive_timeout;
+  double watchdog_period; // s between checks of last_alive_time
+  ros::Duration heartbeat_period;
+  ros::Time last_zero_time;
+  WatchdogStats watchdog_stats;
 
  public:
   PWMController();
   void ThrustCB(const riptide_msgs::ThrustStamped::ConstPtr &thrust);
   void SwitchCB(const riptide_msgs::SwitchState::ConstPtr &state);
+  void WatchdogCB(const ros::TimerEvent &event);
+  void OutputCB(const ros::TimerEvent &event);
+  void DiagnosticsCB(const ros::TimerEvent &event);
   void Loop();
+
+  // Timer periods Loop() uses, for callers that drive the callbacks themselves
+  double OutputPeriod() const { return 1.0 / output_rate; }
+  double WatchdogPeriod() const { return watchdog_period; }
 };
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef QP_ALLOCATOR_H
+#define QP_ALLOCATOR_H
+
+#include "riptide_controllers/thrust_allocation.h"
+
+// Weights of the QP objective
+struct QPOptions
+{
+  double tracking_weight; // Acceleration error [(m/s^2)^-2], keep large so tracking comes first
+  double power_weight;    // Thrust squared [N^-2], a stand-in for electrical power
+  double rate_weight;     // Change from the previous thrust [N^-2]
+  int max_iterations;     // Active-set changes per solve
+
+  QPOptions() : tracking_weight(1e6), power_weight(1.0), rate_weight(1.0), max_iterations(4 * NUM_THRUSTERS) {}
+};
+
+// Power- and rate-aware thrust allocation.
+// Minimizes  tracking * |A*u - target|^2 + power * sum(w_i * u_i^2) + rate * |u - u_prev|^2
+// subject to min_thrust <= u <= max_thrust, with a primal active-set method on
+// fixed-size 10x10 matrices. Among the thrust vectors that achieve the command,
+// it picks the one that draws the least power and moves the least since the last
+// command; saturation is handled by the constraints instead of redistribution.
+class QPAllocator
+{
+ private:
+  enum Bound { FREE, LOWER, UPPER, FIXED };
+  typedef Eigen::Matrix<double, NUM_THRUSTERS, NUM_THRUSTERS> Hessian;
+
+  VehicleProperties props;
+  ThrusterGeometry geometry;
+  AllocationMatrix A;
+  ThrustVector power; // Per-thruster power weights
+  QPOptions options;
+  Hessian H;          // Constant part of the objective
+  WarmStartOptions warm_start;
+  LastAllocation last;
+  ThrustVector previous; // Last thrust sent, for the rate term
+  Bound active[NUM_THRUSTERS];
+
+  void rebuild();
+  void solveActive(const ThrustVector &g, const ThrustVector &u, ThrustVector &u_star) const;
+
+ public:
+  QPAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+              const ThrustVector &weights = ThrustVector::Ones(), const QPOptions &qp = QPOptions(),
+              const WarmStartOptions &warm = WarmStartOptions());
+  AllocationStats allocate(const Vector6d &cmd, const VehicleState &state, ThrustVector &thrust);
+  void setAllocated(const bool allocated[NUM_THRUSTERS]);
+  const AllocationMatrix &matrix() const { return A; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
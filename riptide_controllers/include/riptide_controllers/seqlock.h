@@ -0,0 +1,52 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+
+// Single-writer, multi-reader sequence lock.
+// The writer never blocks; a reader that overlaps a write retries its copy.
+// T must be plain data (copyable with no side effects), since a reader may
+// briefly copy a half-written value before discarding it.
+template <typename T>
+class SeqLock
+{
+ private:
+  std::atomic<unsigned> seq;
+  T data;
+
+ public:
+  SeqLock() : seq(0), data() {}
+  explicit SeqLock(const T &value) : seq(0), data(value) {}
+
+  // Only one thread may call store()
+  void store(const T &value)
+  {
+    unsigned s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed); // Odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    data = value;
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  T load() const
+  {
+    T copy;
+    unsigned before, after;
+    do
+    {
+      before = seq.load(std::memory_order_acquire);
+      copy = data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return copy;
+  }
+
+  // Number of completed writes
+  unsigned version() const
+  {
+    return seq.load(std::memory_order_acquire) / 2;
+  }
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef THRUST_ALLOCATION_H
+#define THRUST_ALLOCATION_H
+
+#include <Eigen/Dense>
+
+// Thruster indices, in the same order as riptide_msgs/Thrust
+enum Thruster
+{
+  SURGE_PORT_HI,
+  SURGE_STBD_HI,
+  SURGE_PORT_LO,
+  SURGE_STBD_LO,
+  SWAY_FWD,
+  SWAY_AFT,
+  HEAVE_PORT_FWD,
+  HEAVE_STBD_FWD,
+  HEAVE_PORT_AFT,
+  HEAVE_STBD_AFT,
+  NUM_THRUSTERS
+};
+
+// Thruster names as used for the URDF links (<name>_link) and riptide_msgs/Thrust
+extern const char *const THRUSTER_NAMES[NUM_THRUSTERS];
+
+// Rows of the allocation matrix: surge, sway, heave, roll, pitch, yaw
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef Eigen::Matrix<double, NUM_THRUSTERS, 1> ThrustVector;
+typedef Eigen::Matrix<double, 6, NUM_THRUSTERS> AllocationMatrix;
+
+// Physical properties used by every allocation mode
+struct VehicleProperties
+{
+  double mass;          // kg
+  double volume;        // m^3
+  double gravity;       // m/s^2
+  double water_density; // kg/m^3
+  double buoyancy;      // N
+  double Ixx, Iyy, Izz; // kg*m^2
+  double min_thrust;    // N
+  double max_thrust;    // N
+
+  VehicleProperties();
+};
+
+// Thruster positions are in meters relative to the center of mass.
+// Directions are the unit vectors along which positive thrust acts.
+struct ThrusterGeometry
+{
+  Eigen::Vector3d position[NUM_THRUSTERS];
+  Eigen::Vector3d direction[NUM_THRUSTERS];
+  bool allocated[NUM_THRUSTERS]; // Unallocated thrusters are always commanded 0 N
+
+  ThrusterGeometry();
+};
+
+// Vehicle state the allocation depends on
+struct VehicleState
+{
+  Eigen::Matrix3d R_wRelb; // World relative to body
+  Eigen::Vector3d ang_v;   // rad/s
+  bool buoyant;
+
+  VehicleState();
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Per-solve statistics reported by the allocators
+struct AllocationStats
+{
+  int iterations; // Solver iterations or redistribution passes
+  int saturated;  // Number of thrusters at MIN_THRUST/MAX_THRUST
+  double residual; // Norm of the acceleration error [m/s^2, rad/s^2]
+
+  AllocationStats() : iterations(0), saturated(0), residual(0.0) {}
+};
+
+// Warm starting seeds each solve from the previous one and reuses the previous
+// thrust outright when the demanded acceleration has barely changed
+struct WarmStartOptions
+{
+  bool enabled;
+  double tolerance; // Largest change in demanded acceleration that reuses the last thrust
+
+  WarmStartOptions() : enabled(false), tolerance(1e-3) {}
+};
+
+// The most recent solution, kept for warm starting
+struct LastAllocation
+{
+  bool valid;
+  Vector6d target; // Demanded acceleration minus state accelerations
+  ThrustVector thrust;
+
+  LastAllocation() : valid(false) {}
+  bool reusable(const Vector6d &new_target, double tolerance) const
+  {
+    return valid && (new_target - target).cwiseAbs().maxCoeff() < tolerance;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Maps thruster forces to body accelerations (without the state-dependent terms)
+AllocationMatrix buildAllocationMatrix(const VehicleProperties &props, const ThrusterGeometry &geometry);
+
+// Buoyancy and gyroscopic accelerations, which the thrusters do not control
+Vector6d stateAcceleration(const VehicleProperties &props, const VehicleState &state);
+
+// Number of thrusters sitting on one of the thrust limits
+int countSaturated(const VehicleProperties &props, const ThrusterGeometry &geometry, const ThrustVector &thrust);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef THRUST_TO_PWM_H
+#define THRUST_TO_PWM_H
+
+#include "riptide_controllers/thrust_allocation.h"
+
+#define PWM_NEUTRAL 1500
+
+// Two-segment linear thrust-to-PWM calibration for every thruster, stored as
+// one array per coefficient (channels in Thruster order) so the conversion
+// runs down contiguous, aligned columns
+struct PwmCalibration
+{
+  alignas(32) float neg_slope[NUM_THRUSTERS]; // PWM per N below the dead band
+  alignas(32) float neg_xint[NUM_THRUSTERS];
+  alignas(32) float pos_slope[NUM_THRUSTERS]; // PWM per N above the dead band
+  alignas(32) float pos_xint[NUM_THRUSTERS];
+  float dead_band;                            // N, smaller forces give neutral PWM
+  int pwm_min, pwm_max;                       // Valid ESC pulse range (us)
+
+  // Every channel neutral, ESC range 1100-1900 us, 0.01 N dead band
+  PwmCalibration();
+};
+
+// Converts all channels at once. Branch-free, so the compiler can vectorize it.
+// Matches PWMController's per-thruster conversion, plus clamping to the ESC range.
+void thrustToPwm(const PwmCalibration &cal, const float thrust[NUM_THRUSTERS], int pwm[NUM_THRUSTERS]);
+
+// Moves every channel of pwm towards target by at most max_step[i] (us). The
+// output is kept in float so slow rates still advance at high output rates.
+void slewPwm(const float target[NUM_THRUSTERS], const float max_step[NUM_THRUSTERS], float pwm[NUM_THRUSTERS]);
+
+#endif
@@ -2,20 +2,74 @@
 #define THRUSTER_CONTROLLER_H
 
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include <string>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
-#include "ceres/ceres.h"
 #include "glog/logging.h"
 
 #include "ros/ros.h"
 #include "tf/transform_listener.h"
+#include "urdf/model.h"
 #include "geometry_msgs/Vector3.h"
 #include "geometry_msgs/Accel.h"
 #include "riptide_msgs/Imu.h"
 #include "imu_3dm_gx4/FilterOutput.h"
-#include "riptide_msgs/Depth.h"     //<-
+#include "riptide_msgs/DepthState.h"     //<-
 
 #include "riptide_msgs/ThrustStamped.h"
+#include "riptide_msgs/ThrusterMask.h"
+#include "riptide_msgs/SetThrusterMask.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "riptide_controllers/allocation_cache.h"
+#include "riptide_controllers/allocation_kernel.h"
+#include "riptide_controllers/ceres_allocator.h"
+#include "riptide_controllers/pseudo_inverse_allocator.h"
+#include "riptide_controllers/qp_allocator.h"
+#include "riptide_controllers/seqlock.h"
+
+// Latest acceleration command and when it arrived (monotonic clock, s)
+struct TimedCommand
+{
+  Vector6d accel;
+  double stamp;
+
+  TimedCommand() : accel(Vector6d::Zero()), stamp(0.0) {}
+};
+
+// Thrusters that are healthy enough to allocate to
+struct AllocationMask
+{
+  bool allocated[NUM_THRUSTERS];
+
+  AllocationMask() { std::fill(allocated, allocated + NUM_THRUSTERS, true); }
+};
+
+// Allocation timing, accumulated between diagnostics messages
+struct LoopStats
+{
+  long cycles, deadline_misses, solves;
+  long cache_hits, cache_misses, cache_bypassed;
+  double jitter_sum, jitter_max; // s
+  double solve_sum, solve_max;   // s
+  long depth_samples;
+  double depth_age_sum, depth_age_max; // s, from the depth sample's stamp to its arrival here
+
+  LoopStats() { reset(); }
+  void reset()
+  {
+    cycles = deadline_misses = solves = 0;
+    cache_hits = cache_misses = cache_bypassed = 0;
+    jitter_sum = jitter_max = solve_sum = solve_max = 0.0;
+    depth_samples = 0;
+    depth_age_sum = depth_age_max = 0.0;
+  }
+};
 
 class ThrusterController
 {
@@ -25,28 +79,67 @@ class ThrusterController
   ros::Subscriber state_sub;
   ros::Subscriber cmd_sub;
   ros::Subscriber depth_sub;  //<-
+  ros::Subscriber mask_sub;
+  ros::ServiceServer mask_srv;
   ros::Publisher cmd_pub;
+  ros::Publisher diag_pub;
+  ros::WallTimer diag_timer;
   riptide_msgs::ThrustStamped thrust;
   // Math
-  ceres::Problem problem;
-  ceres::Solver::Options options;
-  ceres::Solver::Summary summary;
+  enum AllocationMode { CERES, PSEUDO_INVERSE, QP };
+  AllocationMode mode;
+  VehicleProperties vehicle;
+  ThrusterGeometry geometry;
+  // State handoff from the IMU/depth callbacks, which may run on other threads
+  SeqLock<VehicleState> attitude;
+  std::atomic<bool> buoyant;
+  int spinner_threads;
+  CeresAllocator *ceres_allocator;
+  PseudoInverseAllocator *pinv_allocator;
+  QPAllocator *qp_allocator;
+  AllocationCache cache; // Only touched by whichever thread runs allocate()
+  std::atomic<size_t> cache_entries;
+  // Fixed-rate allocation loop (loop_rate = 0 solves on every command instead)
+  double loop_rate;      // Hz
+  int loop_priority;     // SCHED_FIFO priority, 0 = normal scheduling
+  double command_timeout; // s, stop publishing when commands stop arriving
+  SeqLock<TimedCommand> command;
+  std::thread allocation_thread;
+  std::atomic<bool> running;
+  std::mutex stats_mutex;
+  LoopStats stats;
+  // Thruster health mask, applied to the allocators before the next solve
+  std::mutex mask_mutex; // Serializes the topic and service writers
+  SeqLock<AllocationMask> mask;
+  unsigned mask_version; // Last mask version the allocators were rebuilt for
   // Results
-  double surge_stbd_hi, surge_port_hi, surge_port_lo, surge_stbd_lo;
-  double sway_fwd, sway_aft;
-  double heave_port_aft, heave_stbd_aft, heave_stbd_fwd, heave_port_fwd;//<-
+  ThrustVector forces;
   // TF
   tf::TransformListener *listener;
-  tf::StampedTransform tf_surge[4];
-  tf::StampedTransform tf_sway[2];
-  tf::StampedTransform tf_heave[4];
+
+  // Thruster positions, from the fastest source available
+  bool loadGeometryFromURDF();
+  bool loadGeometryFromParams(const ros::NodeHandle &tcp);
+  bool loadGeometryFromTF(double timeout);
+  void applyMask();
 
  public:
-  ThrusterController(char **argv, tf::TransformListener *listener_adr);
+  ThrusterController(char **argv, tf::TransformListener *listener_adr, const ros::NodeHandle &node = ros::NodeHandle());
+  ~ThrusterController();
   void state(const riptide_msgs::Imu::ConstPtr &msg);
-  void depth(const riptide_msgs::Depth::ConstPtr &msg);     //<-
+  void depth(const riptide_msgs::DepthState::ConstPtr &msg);     //<-
   void callback(const geometry_msgs::Accel::ConstPtr &a);
+  void maskCallback(const riptide_msgs::ThrusterMask::ConstPtr &msg);
+  bool setMask(riptide_msgs::SetThrusterMask::Request &req, riptide_msgs::SetThrusterMask::Response &res);
+  std::string updateMask(const riptide_msgs::ThrusterMask &msg);
+  void allocate(const Vector6d &cmd);
+  void allocationLoop();
+  void publishDiagnostics(const ros::WallTimerEvent &event);
+  void start();
+  void stop();
   void loop();
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
 #endif
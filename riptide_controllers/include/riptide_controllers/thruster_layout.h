@@ -0,0 +1,82 @@
+// Generated by scripts/generate_thruster_geometry.py from riptide_description.
+// DO NOT EDIT. Regenerate after changing riptide_properties.xacro.
+#ifndef THRUSTER_LAYOUT_H
+#define THRUSTER_LAYOUT_H
+
+#include "riptide_controllers/thrust_allocation.h"
+
+// Position (m, relative to base_link) and thrust direction of each thruster
+template <int I>
+struct LayoutThruster;
+
+template <>
+struct LayoutThruster<SURGE_PORT_HI>
+{
+  static constexpr double x = -0.2057, y = 0.1829, z = 0.1256;
+  static constexpr double dx = 1.0, dy = 0.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<SURGE_STBD_HI>
+{
+  static constexpr double x = -0.2057, y = -0.1819, z = 0.1256;
+  static constexpr double dx = 1.0, dy = 0.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<SURGE_PORT_LO>
+{
+  static constexpr double x = -0.2057, y = 0.1829, z = -0.0966;
+  static constexpr double dx = 1.0, dy = 0.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<SURGE_STBD_LO>
+{
+  static constexpr double x = -0.2057, y = -0.1819, z = -0.0966;
+  static constexpr double dx = 1.0, dy = 0.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<SWAY_FWD>
+{
+  static constexpr double x = 0.3957, y = 0.0005, z = -0.0966;
+  static constexpr double dx = 0.0, dy = 1.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<SWAY_AFT>
+{
+  static constexpr double x = -0.3563, y = 0.0005, z = -0.0966;
+  static constexpr double dx = 0.0, dy = 1.0, dz = 0.0;
+};
+
+template <>
+struct LayoutThruster<HEAVE_PORT_FWD>
+{
+  static constexpr double x = 0.3005, y = 0.1829, z = -0.0161;
+  static constexpr double dx = 0.0, dy = 0.0, dz = 1.0;
+};
+
+template <>
+struct LayoutThruster<HEAVE_STBD_FWD>
+{
+  static constexpr double x = 0.3005, y = -0.1819, z = -0.0161;
+  static constexpr double dx = 0.0, dy = 0.0, dz = 1.0;
+};
+
+template <>
+struct LayoutThruster<HEAVE_PORT_AFT>
+{
+  static constexpr double x = -0.2543, y = 0.1829, z = -0.0161;
+  static constexpr double dx = 0.0, dy = 0.0, dz = 1.0;
+};
+
+template <>
+struct LayoutThruster<HEAVE_STBD_AFT>
+{
+  static constexpr double x = -0.2543, y = -0.1819, z = -0.0161;
+  static constexpr double dx = 0.0, dy = 0.0, dz = 1.0;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#!/usr/bin/env python
+# Convert a recorded dive into a trace for allocation_benchmark.
+# Usage: bag_to_trace.py dive.bag trace.csv
+# Writes one row per command/accel message with the latest state/imu and state/depth.
+import sys
+import rosbag
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: bag_to_trace.py dive.bag trace.csv")
+        sys.exit(1)
+
+    imu = None
+    depth = 0.0
+    rows = 0
+    with open(sys.argv[2], 'w') as out:
+        out.write("time,ax,ay,az,alpha_x,alpha_y,alpha_z,roll,pitch,yaw,wx,wy,wz,depth\n")
+        bag = rosbag.Bag(sys.argv[1])
+        for topic, msg, t in bag.read_messages(topics=['/command/accel', '/state/imu', '/state/depth']):
+            if topic == '/state/imu':
+                imu = msg
+            elif topic == '/state/depth':
+                depth = msg.depth
+            elif imu is not None:
+                out.write("%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f\n" % (
+                    t.to_sec(), msg.linear.x, msg.linear.y, msg.linear.z,
+                    msg.angular.x, msg.angular.y, msg.angular.z,
+                    imu.euler_rpy.x, imu.euler_rpy.y, imu.euler_rpy.z,
+                    imu.ang_v.x, imu.ang_v.y, imu.ang_v.z, depth))
+                rows += 1
+        bag.close()
+    print("Wrote %d samples to %s" % (rows, sys.argv[2]))
+
+if __name__ == '__main__':
+    main()
@@ -2,7 +2,7 @@
 import numpy as np
 from matplotlib import pyplot as plt
 import rospy
-from riptide_msgs.msg import Depth
+from riptide_msgs.msg import Depth, DepthState
 #Need to learn how to import ros msgs.
 
 def update_cmd(msg):
@@ -30,6 +30,6 @@ if __name__ == '__main__':
     rospy.init_node("plotter")
     rospy.Subscriber("command/depth", Depth, update_cmd)
     
-    rospy.Subscriber("state/depth", Depth, update_state)
+    rospy.Subscriber("state/depth", DepthState, update_state)
     plt.show()
     rospy.spin()
\ No newline at end of file
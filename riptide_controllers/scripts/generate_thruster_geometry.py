@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+# Generate cfg/thruster_geometry.yaml and include/riptide_controllers/thruster_layout.h
+# from the riptide_description xacro properties, so thruster_controller can start
+# without waiting on TF and the allocation matrix can be built from compile-time constants.
+# Usage: generate_thruster_geometry.py [riptide_properties.xacro]
+import os
+import re
+import sys
+
+THRUSTERS = ['surge_port_hi', 'surge_stbd_hi', 'surge_port_lo', 'surge_stbd_lo', 'sway_fwd',
+             'sway_aft', 'heave_port_fwd', 'heave_stbd_fwd', 'heave_port_aft', 'heave_stbd_aft']
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_XACRO = os.path.join(HERE, '..', '..', 'riptide_description', 'urdf', 'riptide_properties.xacro')
+OUTPUT = os.path.join(HERE, '..', 'cfg', 'thruster_geometry.yaml')
+HEADER = os.path.join(HERE, '..', 'include', 'riptide_controllers', 'thruster_layout.h')
+
+# Thrust direction by thruster type, as in ThrusterGeometry
+DIRECTIONS = {'surge': (1, 0, 0), 'sway': (0, 1, 0), 'heave': (0, 0, 1)}
+
+def load_properties(path):
+    props = {}
+    for name, value in re.findall(r'<xacro:property\s+name="(\w+)"\s+value="([^"]*)"', open(path).read()):
+        props[name] = value
+    return props
+
+def vector(props, name):
+    return [float(v) for v in props[name].split()]
+
+def add(a, b):
+    return [x + y for x, y in zip(a, b)]
+
+def thruster_positions(props):
+    # base_link -> housing_link -> chassis_link -> <thruster>_link, all without rotation
+    chassis = add(vector(props, 'base_housing'), vector(props, 'housing_chassis'))
+    return [(name, add(chassis, vector(props, 'chassis_' + name))) for name in THRUSTERS]
+
+def write_header(positions):
+    with open(HEADER, 'w') as out:
+        out.write("// Generated by scripts/generate_thruster_geometry.py from riptide_description.\n")
+        out.write("// DO NOT EDIT. Regenerate after changing riptide_properties.xacro.\n")
+        out.write("#ifndef THRUSTER_LAYOUT_H\n#define THRUSTER_LAYOUT_H\n\n")
+        out.write('#include "riptide_controllers/thrust_allocation.h"\n\n')
+        out.write("// Position (m, relative to base_link) and thrust direction of each thruster\n")
+        out.write("template <int I>\nstruct LayoutThruster;\n")
+        for name, p in positions:
+            d = DIRECTIONS[name.split('_')[0]]
+            out.write("\ntemplate <>\nstruct LayoutThruster<%s>\n{\n" % name.upper())
+            out.write("  static constexpr double x = %.4f, y = %.4f, z = %.4f;\n" % tuple(p))
+            out.write("  static constexpr double dx = %.1f, dy = %.1f, dz = %.1f;\n" % d)
+            out.write("};\n")
+        out.write("\n#endif\n")
+
+def main():
+    xacro = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_XACRO
+    positions = thruster_positions(load_properties(xacro))
+    write_header(positions)
+    print("Wrote %s" % os.path.normpath(HEADER))
+    with open(OUTPUT, 'w') as out:
+        out.write("# Generated by scripts/generate_thruster_geometry.py from riptide_description.\n")
+        out.write("# DO NOT EDIT. Regenerate after changing riptide_properties.xacro.\n")
+        out.write("# Thruster positions relative to base_link (m)\n")
+        for name, p in positions:
+            out.write("%s: [%.4f, %.4f, %.4f]\n" % (name, p[0], p[1], p[2]))
+    print("Wrote %s" % os.path.normpath(OUTPUT))
+
+if __name__ == '__main__':
+    main()
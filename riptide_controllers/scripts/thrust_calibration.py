@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+# Build per-thruster thrust-to-PWM lookup tables from bench CSVs for pwm_controller.
+#
+# Usage: thrust_calibration.py --column N [--scale S] [--output cfg/thrust_lut.yaml] bench.csv ...
+#
+# Each CSV row is "pwm, value, value, ..."; column N (0 = pwm) holds the measured
+# force, multiplied by S to get newtons. The thruster comes from the file name
+# (heave_port_aft.csv and heave_port_aft2.csv both feed heave_port_aft).
+# Note: the CSVs written by riptide_hardware/scripts/mag_offset_calibration.py hold
+# magnetometer readings, not force, and cannot be used here.
+#
+# For every thruster the samples are averaged per PWM, a monotone curve is fit on
+# each side of neutral (pool adjacent violators), and the curve is inverted onto a
+# uniform thrust grid. pwm_controller interpolates linearly in that grid.
+import argparse
+import os
+import re
+
+NEUTRAL = 1500
+ABBREVIATIONS = {'surge_port_hi': 'SPH', 'surge_stbd_hi': 'SSH', 'surge_port_lo': 'SPL', 'surge_stbd_lo': 'SSL',
+                 'sway_fwd': 'SWF', 'sway_aft': 'SWA', 'heave_port_fwd': 'HPF', 'heave_stbd_fwd': 'HSF',
+                 'heave_port_aft': 'HPA', 'heave_stbd_aft': 'HSA'}
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+def thruster_name(path):
+    return re.sub(r'\d+$', '', os.path.splitext(os.path.basename(path))[0])
+
+def load(paths, column, scale):
+    data = {}
+    for path in paths:
+        samples = data.setdefault(thruster_name(path), {})
+        for line in open(path):
+            fields = line.split(',')
+            if len(fields) > column:
+                samples.setdefault(int(float(fields[0])), []).append(float(fields[column]) * scale)
+    return data
+
+def isotonic(y):
+    # Pool adjacent violators: least squares non-decreasing fit
+    blocks = []
+    for value in y:
+        blocks.append([value, 1])
+        while len(blocks) > 1 and blocks[-2][0] > blocks[-1][0]:
+            v, n = blocks.pop()
+            blocks[-1] = [(blocks[-1][0] * blocks[-1][1] + v * n) / (blocks[-1][1] + n), blocks[-1][1] + n]
+    return [v for v, n in blocks for _ in range(n)]
+
+def fit(samples):
+    # Mean force per PWM, with the force at neutral taken as the zero
+    pwm = sorted(samples)
+    force = [sum(samples[p]) / len(samples[p]) for p in pwm]
+    if NEUTRAL in samples:
+        zero = force[pwm.index(NEUTRAL)]
+        force = [f - zero for f in force]
+
+    # Reversed thrusters push less as PWM rises
+    direction = 1.0 if sum((p - NEUTRAL) * f for p, f in zip(pwm, force)) >= 0 else -1.0
+    curve = [direction * f for f in isotonic([direction * f for f in force])]
+
+    # One side of neutral per thrust sign, as (|force|, pwm) pairs
+    pos = [(abs(f), p) for p, f in zip(pwm, curve) if direction * (p - NEUTRAL) > 0]
+    neg = [(abs(f), p) for p, f in zip(pwm, curve) if direction * (p - NEUTRAL) < 0]
+    return pos, neg
+
+def inverse(side):
+    # In flat stretches keep the PWM closest to neutral: same thrust for less effort
+    closest = {0.0: NEUTRAL}
+    for f, p in side:
+        if f not in closest or abs(p - NEUTRAL) < abs(closest[f] - NEUTRAL):
+            closest[f] = p
+    return sorted(closest.items())
+
+def interpolate(points, x):
+    for (x0, y0), (x1, y1) in zip(points, points[1:]):
+        if x <= x1:
+            return y0 + (y1 - y0) * (x - x0) / (x1 - x0)
+    return points[-1][1]
+
+def table(samples, step):
+    pos, neg = fit(samples)
+    if not pos or not neg:
+        return None
+    pos, neg = inverse(pos), inverse(neg)
+    n = int(min(pos[-1][0], neg[-1][0]) / step)
+    if n == 0:
+        return None
+    thrust = [i * step for i in range(-n, n + 1)]
+    pwm = [int(round(interpolate(neg if t < 0 else pos, abs(t)))) for t in thrust]
+    return thrust, pwm
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('csv', nargs='+')
+    parser.add_argument('--column', type=int, required=True, help='CSV column holding the measured force')
+    parser.add_argument('--scale', type=float, default=1.0, help='Multiplier from that column to N')
+    parser.add_argument('--step', type=float, default=0.1, help='Thrust grid spacing (N)')
+    parser.add_argument('--output', default=os.path.join(HERE, '..', 'cfg', 'thrust_lut.yaml'))
+    args = parser.parse_args()
+
+    with open(args.output, 'w') as out:
+        out.write("# Generated by scripts/thrust_calibration.py from %s\n" %
+                  ", ".join(os.path.basename(p) for p in args.csv))
+        out.write("# Load into the pwm_controller namespace (pwm_controller.launch lut:=true)\n")
+        for name, samples in sorted(load(args.csv, args.column, args.scale).items()):
+            if name not in ABBREVIATIONS:
+                print("Skipping %s: not a thruster name" % name)
+                continue
+            lut = table(samples, args.step)
+            if lut is None:
+                print("Skipping %s: no thrust measured on both sides of %d" % (name, NEUTRAL))
+                continue
+            thrust, pwm = lut
+            out.write("%s:\n  LUT:\n" % ABBREVIATIONS[name])
+            out.write("    THRUST_MIN: %f\n    THRUST_STEP: %f\n" % (thrust[0], args.step))
+            out.write("    PWM: [%s]\n" % ", ".join(str(p) for p in pwm))
+            print("%s: %d entries, +/-%.2f N" % (name, len(pwm), -thrust[0]))
+    print("Wrote %s" % os.path.normpath(args.output))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,262 @@
+// Thrust allocation benchmark. Runs without a ROS master.
+//
+// Usage: allocation_benchmark [trace.csv ...]
+//
+// Feeds synthetic command traces, plus any recorded traces given on the command
+// line (see scripts/bag_to_trace.py), through every allocation mode and reports
+// latency percentiles, iterations, residual error, saturation counts, and the
+// mean squared thrust (power proxy) and mean thrust change between commands.
+//
+// Trace CSV columns (one row per command/accel message, angles in degrees):
+//   time, accel linear x y z, accel angular x y z, roll, pitch, yaw, ang_v x y z, depth
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "glog/logging.h"
+#include "riptide_controllers/allocation_kernel.h"
+#include "riptide_controllers/ceres_allocator.h"
+#include "riptide_controllers/pseudo_inverse_allocator.h"
+#include "riptide_controllers/qp_allocator.h"
+
+#define PI 3.141592653
+
+// Same threshold the thruster controller uses
+#define BUOYANCY_DEPTH 0.2
+
+// Fixed seed so every run sees the same synthetic traces
+#define SEED 42
+
+struct TraceSample
+{
+  Vector6d cmd;
+  VehicleState state;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<TraceSample, Eigen::aligned_allocator<TraceSample> > Trace;
+
+struct NamedTrace
+{
+  std::string name;
+  Trace samples;
+};
+
+// Attitude [deg], angular velocity [deg/s] and depth [m] to allocator state
+VehicleState makeState(double roll, double pitch, double yaw, const Eigen::Vector3d &ang_v, double depth)
+{
+  VehicleState state;
+  state.R_wRelb = (Eigen::AngleAxisd(yaw * PI / 180, Eigen::Vector3d::UnitZ()) *
+                   Eigen::AngleAxisd(pitch * PI / 180, Eigen::Vector3d::UnitY()) *
+                   Eigen::AngleAxisd(roll * PI / 180, Eigen::Vector3d::UnitX())).toRotationMatrix();
+  state.ang_v = ang_v * PI / 180;
+  state.buoyant = depth > BUOYANCY_DEPTH;
+  return state;
+}
+
+bool loadTrace(const std::string &path, NamedTrace &trace)
+{
+  std::ifstream file(path.c_str());
+  if (!file.is_open())
+    return false;
+
+  trace.name = path.substr(path.find_last_of('/') + 1);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::vector<double> v;
+    std::stringstream ss(line);
+    std::string field;
+    bool numeric = true;
+    while (numeric && std::getline(ss, field, ','))
+    {
+      char *end;
+      v.push_back(strtod(field.c_str(), &end));
+      numeric = end != field.c_str();
+    }
+    if (!numeric || v.size() < 14)
+      continue; // Header or malformed row
+
+    TraceSample s;
+    s.cmd << v[1], v[2], v[3], v[4], v[5], v[6];
+    s.state = makeState(v[7], v[8], v[9], Eigen::Vector3d(v[10], v[11], v[12]), v[13]);
+    trace.samples.push_back(s);
+  }
+  return !trace.samples.empty();
+}
+
+// Synthetic traces at 100 Hz, 60 s each
+std::vector<NamedTrace> syntheticTraces()
+{
+  std::vector<NamedTrace> traces;
+  std::mt19937 rng(SEED);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  const int n = 6000;
+  const double dt = 0.01;
+
+  // Station keeping: small noisy commands, level and submerged
+  NamedTrace hold;
+  hold.name = "station_keeping";
+  for (int i = 0; i < n; i++)
+  {
+    TraceSample s;
+    for (int j = 0; j < 6; j++)
+      s.cmd(j) = 0.02 * noise(rng);
+    s.state = makeState(noise(rng), noise(rng), 0.0, Eigen::Vector3d(noise(rng), noise(rng), noise(rng)), 1.0);
+    hold.samples.push_back(s);
+  }
+  traces.push_back(hold);
+
+  // Steps in a random axis every second
+  NamedTrace steps;
+  steps.name = "steps";
+  Vector6d step = Vector6d::Zero();
+  for (int i = 0; i < n; i++)
+  {
+    if (i % 100 == 0)
+      step(rng() % 6) = 0.4 * noise(rng);
+    TraceSample s;
+    s.cmd = step;
+    s.state = makeState(0.0, 0.0, 0.0, Eigen::Vector3d::Zero(), 1.0);
+    steps.samples.push_back(s);
+  }
+  traces.push_back(steps);
+
+  // Slow sinusoids on every axis while the vehicle rolls, pitches and turns
+  NamedTrace sweep;
+  sweep.name = "sweep";
+  for (int i = 0; i < n; i++)
+  {
+    double t = i * dt;
+    TraceSample s;
+    for (int j = 0; j < 6; j++)
+      s.cmd(j) = 0.3 * sin(2 * PI * (0.1 + 0.05 * j) * t);
+    s.state = makeState(15 * sin(0.5 * t), 10 * sin(0.3 * t), fmod(20 * t, 360) - 180,
+                        Eigen::Vector3d(7.5 * cos(0.5 * t), 3 * cos(0.3 * t), 20), 2.0);
+    sweep.samples.push_back(s);
+  }
+  traces.push_back(sweep);
+
+  // Large commands that drive thrusters into their limits
+  NamedTrace saturating;
+  saturating.name = "saturating";
+  for (int i = 0; i < n; i++)
+  {
+    TraceSample s;
+    for (int j = 0; j < 6; j++)
+      s.cmd(j) = 2.0 * noise(rng);
+    s.state = makeState(5 * noise(rng), 5 * noise(rng), 0.0, Eigen::Vector3d(noise(rng), noise(rng), noise(rng)),
+                        i % 1000 < 500 ? 0.0 : 1.0);
+    saturating.samples.push_back(s);
+  }
+  traces.push_back(saturating);
+
+  return traces;
+}
+
+// Thruster layout generated from riptide_description
+ThrusterGeometry riptideGeometry()
+{
+  ThrusterGeometry geometry = layoutGeometry();
+
+  // Matches the thruster controller
+  geometry.allocated[SURGE_PORT_HI] = false;
+  geometry.allocated[SURGE_STBD_HI] = false;
+  return geometry;
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+  size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+template <typename Allocator>
+void run(const char *mode, Allocator &allocator, const NamedTrace &trace)
+{
+  std::vector<double> latency; // us
+  latency.reserve(trace.samples.size());
+  double iterations = 0, residual = 0, max_residual = 0;
+  double power = 0, rate = 0;
+  int saturated_samples = 0;
+  ThrustVector thrust, previous = ThrustVector::Zero();
+
+  // Warm up caches before timing
+  for (size_t i = 0; i < trace.samples.size() && i < 100; i++)
+    allocator.allocate(trace.samples[i].cmd, trace.samples[i].state, thrust);
+
+  for (size_t i = 0; i < trace.samples.size(); i++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    AllocationStats stats = allocator.allocate(trace.samples[i].cmd, trace.samples[i].state, thrust);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    latency.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    iterations += stats.iterations;
+    residual += stats.residual;
+    max_residual = std::max(max_residual, stats.residual);
+    if (stats.saturated > 0)
+      saturated_samples++;
+    power += thrust.squaredNorm();
+    rate += (thrust - previous).cwiseAbs().sum();
+    previous = thrust;
+  }
+
+  std::sort(latency.begin(), latency.end());
+  double n = trace.samples.size();
+  printf("%-18s %-16s %9.2f %9.2f %9.2f %8.2f %11.3e %11.3e %9d %11.2f %9.3f\n", trace.name.c_str(), mode,
+         percentile(latency, 0.5), percentile(latency, 0.99), latency.back(), iterations / n, residual / n,
+         max_residual, saturated_samples, power / n, rate / n);
+}
+
+int main(int argc, char **argv)
+{
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<NamedTrace> traces = syntheticTraces();
+  for (int i = 1; i < argc; i++)
+  {
+    NamedTrace trace;
+    if (loadTrace(argv[i], trace))
+      traces.push_back(trace);
+    else
+      fprintf(stderr, "Could not load trace %s\n", argv[i]);
+  }
+
+  VehicleProperties vehicle;
+  ThrusterGeometry geometry = riptideGeometry();
+  WarmStartOptions warm;
+  warm.enabled = true;
+
+  printf("%-18s %-16s %9s %9s %9s %8s %11s %11s %9s %11s %9s\n", "trace", "mode", "p50[us]", "p99[us]", "max[us]",
+         "iters", "mean_resid", "max_resid", "saturated", "power[N^2]", "rate[N]");
+  for (size_t t = 0; t < traces.size(); t++)
+  {
+    PseudoInverseAllocator pinv(vehicle, geometry);
+    run("pseudo_inverse", pinv, traces[t]);
+
+    PseudoInverseAllocator pinv_warm(vehicle, geometry, ThrustVector::Ones(), warm);
+    run("pseudo_inv_warm", pinv_warm, traces[t]);
+
+    QPAllocator qp(vehicle, geometry);
+    run("qp", qp, traces[t]);
+
+    QPAllocator qp_warm(vehicle, geometry, ThrustVector::Ones(), QPOptions(), warm);
+    run("qp_warm", qp_warm, traces[t]);
+
+    CeresAllocator ceres(vehicle, geometry);
+    run("ceres", ceres, traces[t]);
+
+    CeresAllocator ceres_warm(vehicle, geometry, warm);
+    run("ceres_warm", ceres_warm, traces[t]);
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "riptide_controllers/allocation_cache.h"
+
+#include <math.h>
+#include <iterator>
+
+AllocationCache::AllocationCache(const CacheOptions &opts) : options(opts)
+{
+  index.reserve(options.capacity);
+}
+
+bool AllocationCache::makeKey(const Vector6d &cmd, const VehicleState &state, AllocationKey &key) const
+{
+  if (state.ang_v.norm() > options.max_ang_v)
+    return false;
+
+  for (int i = 0; i < 6; i++)
+    key.q[i] = static_cast<int32_t>(lround(cmd(i) / options.accel_resolution));
+
+  // Attitude only matters through buoyancy, so all attitudes share a key when surfaced
+  for (int i = 0; i < 3; i++)
+    key.q[6 + i] = state.buoyant ? static_cast<int32_t>(lround(state.R_wRelb(i, 2) / options.tilt_resolution)) : 0;
+  key.q[9] = state.buoyant;
+  return true;
+}
+
+bool AllocationCache::lookup(const AllocationKey &key, ThrustVector &thrust)
+{
+  auto it = index.find(key);
+  if (it == index.end())
+    return false;
+
+  // Mark as most recently used
+  entries.splice(entries.begin(), entries, it->second);
+  thrust = it->second->thrust;
+  return true;
+}
+
+void AllocationCache::insert(const AllocationKey &key, const ThrustVector &thrust)
+{
+  if (!enabled() || index.count(key))
+    return;
+
+  if (entries.size() < options.capacity)
+  {
+    entries.push_front(Entry());
+  }
+  else
+  {
+    // Reuse the least recently used entry
+    index.erase(entries.back().key);
+    entries.splice(entries.begin(), entries, std::prev(entries.end()));
+  }
+
+  entries.front().key = key;
+  entries.front().thrust = thrust;
+  index[key] = entries.begin();
+}
+
+void AllocationCache::clear()
+{
+  entries.clear();
+  index.clear();
+}
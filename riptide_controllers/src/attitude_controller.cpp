@@ -1,4 +1,5 @@
 #include "riptide_controllers/attitude_controller.h"
+#include <boost/make_shared.hpp>
 
 #undef debug
 #undef report
@@ -8,12 +9,6 @@ float round(float d) {
   return floor(d + 0.5);
 }
 
-int main(int argc, char **argv) {
-  ros::init(argc, argv, "attitude_controller");
-  AttitudeController ac;
-  ros::spin();
-}
-
 void AttitudeController::UpdateError() {
 
   sample_duration = ros::Time::now() - sample_start;
@@ -48,8 +43,8 @@ void AttitudeController::UpdateError() {
   error_msg.y = pitch_error;
   error_msg.z = yaw_error;
 
-  error_pub.publish(error_msg);
-  cmd_pub.publish(accel_cmd);
+  error_pub.publish(boost::make_shared<geometry_msgs::Vector3>(error_msg));
+  cmd_pub.publish(boost::make_shared<geometry_msgs::Vector3>(accel_cmd));
   sample_start = ros::Time::now();
 }
 
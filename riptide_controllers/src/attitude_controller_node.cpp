@@ -0,0 +1,7 @@
+#include "riptide_controllers/attitude_controller.h"
+
+int main(int argc, char **argv) {
+  ros::init(argc, argv, "attitude_controller");
+  AttitudeController ac;
+  ros::spin();
+}
@@ -0,0 +1,182 @@
+#include "riptide_controllers/ceres_allocator.h"
+#include "riptide_controllers/allocation_kernel.h"
+
+#undef report
+#undef progress
+
+/*** EQUATIONS ***/
+// These equations solve for linear/angular acceleration in all axes:
+// thrust accelerations (A * u) plus buoyancy and gyroscopic terms must equal the command.
+// A comes from the thruster geometry, so a new layout needs no new equations.
+struct accelerations
+{
+  const AllocationTerms *t;
+  explicit accelerations(const AllocationTerms *terms) : t(terms) {}
+
+  template <typename T>
+  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
+                  const T *const surge_stbd_lo, const T *const sway_fwd, const T *const sway_aft,
+                  const T *const heave_port_fwd, const T *const heave_stbd_fwd, const T *const heave_port_aft,
+                  const T *const heave_stbd_aft, T *residual) const
+  {
+    const T *const u[NUM_THRUSTERS] = { surge_port_hi, surge_stbd_hi, surge_port_lo, surge_stbd_lo, sway_fwd,
+                                        sway_aft, heave_port_fwd, heave_stbd_fwd, heave_port_aft, heave_stbd_aft };
+    for (int r = 0; r < 6; r++)
+      residual[r] = -T(t->target(r));
+    UnrolledProduct<0>::accumulate(t->A, u, residual);
+    return true;
+  }
+};
+
+// All six equations in one block. They are linear in the thrusts, so the
+// Jacobian is just the allocation matrix and is never re-derived.
+class CachedJacobianResidual : public ceres::SizedCostFunction<6, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1>
+{
+ private:
+  const AllocationTerms *t;
+
+ public:
+  explicit CachedJacobianResidual(const AllocationTerms *terms) : t(terms) {}
+
+  virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+  {
+    for (int r = 0; r < 6; r++)
+    {
+      residuals[r] = -t->target(r);
+      for (int j = 0; j < NUM_THRUSTERS; j++)
+        residuals[r] += t->A(r, j) * parameters[j][0];
+    }
+
+    if (jacobians != NULL)
+    {
+      for (int j = 0; j < NUM_THRUSTERS; j++)
+      {
+        if (jacobians[j] == NULL)
+          continue;
+        for (int r = 0; r < 6; r++)
+          jacobians[j][r] = t->A(r, j);
+      }
+    }
+    return true;
+  }
+};
+
+CeresAllocator::CeresAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+                               const WarmStartOptions &warm)
+  : warm_start(warm)
+{
+  terms.props = vehicle;
+  terms.geometry = thrusters;
+  terms.cmd.setZero();
+  terms.target.setZero();
+  terms.A = buildAllocationMatrix(vehicle, thrusters);
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+    x[i] = 0.0;
+
+  // PROBLEM SETUP
+
+  // Add residual blocks (equations)
+  if (warm_start.enabled)
+    addCachedEquations();
+  else
+    addEquations();
+
+  // Set constraints (min/max thruster force)
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    problem.SetParameterLowerBound(&x[i], 0, terms.props.min_thrust);
+    problem.SetParameterUpperBound(&x[i], 0, terms.props.max_thrust);
+
+    // Unallocated thrusters stay at 0 N
+    if (!terms.geometry.allocated[i])
+      problem.SetParameterBlockConstant(&x[i]);
+  }
+
+  // Configure solver
+  options.max_num_iterations = 100;
+  options.linear_solver_type = ceres::DENSE_QR;
+
+#ifdef progress
+  options.minimizer_progress_to_stdout = true;
+#endif
+}
+
+void CeresAllocator::addCachedEquations()
+{
+  problem.AddResidualBlock(new CachedJacobianResidual(&terms), NULL, &x[SURGE_PORT_HI], &x[SURGE_STBD_HI],
+                           &x[SURGE_PORT_LO], &x[SURGE_STBD_LO], &x[SWAY_FWD], &x[SWAY_AFT], &x[HEAVE_PORT_FWD],
+                           &x[HEAVE_STBD_FWD], &x[HEAVE_PORT_AFT], &x[HEAVE_STBD_AFT]);
+}
+
+void CeresAllocator::addEquations()
+{
+  problem.AddResidualBlock(
+      new ceres::AutoDiffCostFunction<accelerations, 6, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1>(new accelerations(&terms)), NULL,
+      &x[SURGE_PORT_HI], &x[SURGE_STBD_HI], &x[SURGE_PORT_LO], &x[SURGE_STBD_LO], &x[SWAY_FWD], &x[SWAY_AFT],
+      &x[HEAVE_PORT_FWD], &x[HEAVE_STBD_FWD], &x[HEAVE_PORT_AFT], &x[HEAVE_STBD_AFT]);
+}
+
+void CeresAllocator::setAllocated(const bool allocated[NUM_THRUSTERS])
+{
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (allocated[i] == terms.geometry.allocated[i])
+      continue;
+    terms.geometry.allocated[i] = allocated[i];
+    if (allocated[i])
+    {
+      problem.SetParameterBlockVariable(&x[i]);
+    }
+    else
+    {
+      x[i] = 0.0;
+      problem.SetParameterBlockConstant(&x[i]);
+    }
+  }
+  terms.A = buildAllocationMatrix(terms.props, terms.geometry);
+  last.valid = false;
+}
+
+AllocationStats CeresAllocator::allocate(const Vector6d &cmd, const VehicleState &state, ThrustVector &thrust)
+{
+  AllocationStats stats;
+  terms.cmd = cmd;
+  terms.state = state;
+  terms.target = cmd - stateAcceleration(terms.props, state);
+
+  if (warm_start.enabled && last.reusable(terms.target, warm_start.tolerance))
+  {
+    thrust = last.thrust;
+    stats.saturated = countSaturated(terms.props, terms.geometry, thrust);
+    stats.residual = (terms.A * thrust - terms.target).norm();
+    return stats;
+  }
+
+  // When warm starting, x still holds the previous solution.
+  // Otherwise these forced initial guesses don't make much of a difference.
+  // We currently experience a sort of gimbal lock w/ or w/o them.
+  if (!warm_start.enabled)
+  {
+    for (int i = 0; i < NUM_THRUSTERS; i++)
+      x[i] = 0.0;
+  }
+
+  // Solve all my problems
+  ceres::Solve(options, &problem, &summary);
+
+#ifdef report
+  std::cout << summary.FullReport() << std::endl;
+#endif
+
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+    thrust(i) = x[i];
+
+  stats.iterations = summary.iterations.size();
+  stats.saturated = countSaturated(terms.props, terms.geometry, thrust);
+  stats.residual = (terms.A * thrust - terms.target).norm();
+
+  last.valid = true;
+  last.target = terms.target;
+  last.thrust = thrust;
+  return stats;
+}
@@ -1,31 +1,32 @@
 #include "riptide_controllers/command_combinator.h"
+#include <boost/make_shared.hpp>
 
-int main(int argc, char **argv) {
-  ros::init(argc, argv, "command_combinator");
-  CommandCombinator cc;
-  ros::spin();
+// A new message each time: roscpp passes shared messages to subscribers in the
+// same process (control_replay) directly, without serializing them
+void CommandCombinator::PublishAccel() {
+  cmd_pub.publish(boost::make_shared<geometry_msgs::Accel>(current_accel));
 }
 
 void CommandCombinator::linearXCB(const std_msgs::Float64::ConstPtr &accel) {
   current_accel.linear.x = accel->data;
-  cmd_pub.publish(current_accel);
+  PublishAccel();
 }
 
 void CommandCombinator::linearYCB(const std_msgs::Float64::ConstPtr &accel) {
   current_accel.linear.y = accel->data;
-  cmd_pub.publish(current_accel);
+  PublishAccel();
 }
 
 void CommandCombinator::linearZCB(const std_msgs::Float64::ConstPtr &accel) {
   current_accel.linear.z = accel->data;
-  cmd_pub.publish(current_accel);
+  PublishAccel();
 }
 
 void CommandCombinator::angularCB(const geometry_msgs::Vector3::ConstPtr &accel) {
   current_accel.angular.x = accel->x;
   current_accel.angular.y = accel->y;
   current_accel.angular.z = accel->z;
-  cmd_pub.publish(current_accel);
+  PublishAccel();
 }
 
 //Subscribe to state/switches
@@ -59,5 +60,5 @@ void CommandCombinator::ResetController() {
     current_accel.angular.x = 0;
     current_accel.angular.y = 0;
     current_accel.angular.z = 0;
-    cmd_pub.publish(current_accel);
+    PublishAccel();
 }
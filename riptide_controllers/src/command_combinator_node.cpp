@@ -0,0 +1,7 @@
+#include "riptide_controllers/command_combinator.h"
+
+int main(int argc, char **argv) {
+  ros::init(argc, argv, "command_combinator");
+  CommandCombinator cc;
+  ros::spin();
+}
@@ -0,0 +1,342 @@
+// Reruns the control stack on a flight log written by riptide_hardware's
+// flight_recorder. It runs in simulated time, as fast as the CPU allows, and
+// writes the thrust and PWM it commands next to what the vehicle commanded.
+//
+// Usage: roslaunch riptide_controllers control_replay.launch log:=<file.rec>
+//
+// Recorded inputs go straight into the stages' callbacks, with ros::Time set
+// to each message's receive time. The stages publish shared messages, which
+// roscpp hands to subscribers in the same process synchronously and without
+// serialization. After every input the callback queue is run until it is
+// empty, so the whole stack settles before the next input and a replay always
+// gives the same result.
+//
+// When the log has the raw sensor topics (imu/filter, arduino/depth),
+// imu_processor and depth_processor are rerun too and the recorded state/imu
+// and state/depth are ignored. processors:=false replays from the recorded state.
+//
+// Output, with times in s from the start of the log:
+//   <output>_thrust.csv, <output>_pwm.csv                   replayed
+//   <output>_thrust_recorded.csv, <output>_pwm_recorded.csv  from the log
+
+#include "riptide_controllers/control_replay.h"
+#include "ros/callback_queue.h"
+
+#include <errno.h>
+#include <string.h>
+#include <boost/bind.hpp>
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "control_replay");
+  ControlReplay replay;
+  return replay.run(argv) ? 0 : 1;
+}
+
+ControlReplay::ControlReplay() : nh(), thrust_csv(0), pwm_csv(0), recorded_thrust_csv(0), recorded_pwm_csv(0),
+                                 inputs(0), thrust_count(0), pwm_count(0)
+{
+}
+
+ControlReplay::~ControlReplay()
+{
+  closeOutput();
+}
+
+template <class M>
+void ControlReplay::route(const std::string &topic,
+                          const boost::function<void(const boost::shared_ptr<M const> &)> &callback)
+{
+  std::shared_ptr<ReplayRoute> &r = routes[topic];
+  if (!r)
+    r.reset(new TypedReplayRoute<M>());
+  static_cast<TypedReplayRoute<M> *>(r.get())->callbacks.push_back(callback);
+}
+
+// Which recorded topics feed which callbacks. The stages' outputs reach the
+// next stage through their own subscriptions.
+void ControlReplay::buildRoutes(bool imu_raw, bool depth_raw)
+{
+  typedef boost::function<void(const riptide_msgs::Depth::ConstPtr &)> DepthCallback;
+  typedef boost::function<void(const riptide_msgs::DepthState::ConstPtr &)> DepthStateCallback;
+  typedef boost::function<void(const riptide_msgs::Imu::ConstPtr &)> ImuCallback;
+  typedef boost::function<void(const riptide_msgs::SwitchState::ConstPtr &)> SwitchCallback;
+  typedef boost::function<void(const std_msgs::Float64::ConstPtr &)> Float64Callback;
+  typedef boost::function<void(const geometry_msgs::Vector3::ConstPtr &)> Vector3Callback;
+  typedef boost::function<void(const riptide_msgs::ThrusterMask::ConstPtr &)> MaskCallback;
+  typedef boost::function<void(const riptide_msgs::ThrustStamped::ConstPtr &)> ThrustCallback;
+  typedef boost::function<void(const riptide_msgs::PwmStamped::ConstPtr &)> PwmCallback;
+  typedef boost::function<void(const imu_3dm_gx4::FilterOutput::ConstPtr &)> FilterCallback;
+  typedef boost::function<void(const imu_3dm_gx4::MagFieldCF::ConstPtr &)> MagCallback;
+
+  IMUProcessor *ip = imu_processor.get();
+  DepthProcessor *dp = depth_processor.get();
+  DepthController *dc = depth_controller.get();
+  AttitudeController *ac = attitude_controller.get();
+  CommandCombinator *cc = command_combinator.get();
+  ThrusterController *tc = thruster_controller.get();
+  PWMController *pc = pwm_controller.get();
+
+  if (imu_raw)
+  {
+    route("imu/filter", FilterCallback(boost::bind(&IMUProcessor::filterCallback, ip, _1)));
+    route("imu/magnetic_field", MagCallback(boost::bind(&IMUProcessor::magCallback, ip, _1)));
+  }
+  else
+  {
+    route("state/imu", ImuCallback(boost::bind(&AttitudeController::ImuCB, ac, _1)));
+    route("state/imu", ImuCallback(boost::bind(&ThrusterController::state, tc, _1)));
+  }
+
+  if (depth_raw)
+  {
+    route("arduino/depth", DepthCallback(boost::bind(&DepthProcessor::DepthCB, dp, _1)));
+  }
+  else
+  {
+    route("state/depth", DepthStateCallback(boost::bind(&DepthController::DepthCB, dc, _1)));
+    route("state/depth", DepthStateCallback(boost::bind(&ThrusterController::depth, tc, _1)));
+  }
+
+  route("state/switches", SwitchCallback(boost::bind(&DepthController::SwitchCB, dc, _1)));
+  route("state/switches", SwitchCallback(boost::bind(&AttitudeController::SwitchCB, ac, _1)));
+  route("state/switches", SwitchCallback(boost::bind(&CommandCombinator::SwitchCB, cc, _1)));
+  route("state/switches", SwitchCallback(boost::bind(&PWMController::SwitchCB, pc, _1)));
+
+  // Commands from the mission layer
+  route("command/depth", DepthCallback(boost::bind(&DepthController::CommandCB, dc, _1)));
+  route("command/attitude", Vector3Callback(boost::bind(&AttitudeController::CommandCB, ac, _1)));
+  route("command/accel/linear/x", Float64Callback(boost::bind(&CommandCombinator::linearXCB, cc, _1)));
+  route("command/accel/linear/y", Float64Callback(boost::bind(&CommandCombinator::linearYCB, cc, _1)));
+  route("command/thruster_mask", MaskCallback(boost::bind(&ThrusterController::maskCallback, tc, _1)));
+
+  // What the vehicle commanded, for comparison
+  route("command/thrust", ThrustCallback(boost::bind(&ControlReplay::recordedThrustCB, this, _1)));
+  route("command/pwm", PwmCallback(boost::bind(&ControlReplay::recordedPwmCB, this, _1)));
+}
+
+// Route of a log topic index, looked up the first time the topic is seen
+ReplayRoute *ControlReplay::findRoute(const FlightLogReader &reader, uint16_t topic)
+{
+  if (topic < topic_routes.size() && topic_routes[topic])
+    return topic_routes[topic];
+
+  std::map<uint16_t, FlightLogTopic>::const_iterator info = reader.topics().find(topic);
+  if (info == reader.topics().end())
+    return 0;
+  std::string name = info->second.name;
+  if (!name.empty() && name[0] == '/')
+    name = name.substr(1);
+
+  std::map<std::string, std::shared_ptr<ReplayRoute> >::iterator r = routes.find(name);
+  if (r == routes.end())
+    return 0;
+  if (r->second->md5sum != info->second.md5sum)
+  {
+    ROS_WARN("Control Replay: %s was recorded as %s, which does not match this build, skipping it",
+             info->second.name.c_str(), info->second.datatype.c_str());
+    routes.erase(r);
+    return 0;
+  }
+
+  if (topic >= topic_routes.size())
+    topic_routes.resize(topic + 1, 0);
+  topic_routes[topic] = r->second.get();
+  return topic_routes[topic];
+}
+
+// Runs everything the last input or timer set off
+void ControlReplay::drain()
+{
+  ros::CallbackQueue *queue = ros::getGlobalCallbackQueue();
+  while (!queue->isEmpty())
+    queue->callAvailable();
+}
+
+// Runs the PWM controller's output and watchdog timers due up to t
+void ControlReplay::advanceTo(const ros::Time &t)
+{
+  while (next_output <= t || next_watchdog <= t)
+  {
+    ros::TimerEvent event;
+    bool output = next_output <= next_watchdog;
+    event.current_expected = event.current_real = output ? next_output : next_watchdog;
+    ros::Time::setNow(event.current_real);
+    if (output)
+    {
+      pwm_controller->OutputCB(event);
+      next_output += ros::Duration(pwm_controller->OutputPeriod());
+    }
+    else
+    {
+      pwm_controller->WatchdogCB(event);
+      next_watchdog += ros::Duration(pwm_controller->WatchdogPeriod());
+    }
+    drain();
+  }
+  ros::Time::setNow(t);
+}
+
+bool ControlReplay::run(char **argv)
+{
+  std::string path, output;
+  bool processors;
+  const char *home = getenv("HOME");
+  nh.param<std::string>("control_replay/log", path, "");
+  nh.param<std::string>("control_replay/output", output, std::string(home ? home : ".") + "/osu-uwrt/replay");
+  nh.param<bool>("control_replay/processors", processors, true); //Rerun the processors when the log has raw data
+
+  // The stages use relative topics, so in the root namespace they would command the vehicle
+  if (ros::this_node::getNamespace() == "/")
+  {
+    ROS_ERROR("Control Replay: run in a namespace of its own (control_replay.launch uses /replay)");
+    return false;
+  }
+
+  FlightLogReader reader;
+  std::string error;
+  if (!reader.open(path, error))
+  {
+    ROS_ERROR("Control Replay: %s", error.c_str());
+    return false;
+  }
+  if (reader.numChunks() == 0)
+  {
+    ROS_ERROR("Control Replay: %s is empty", path.c_str());
+    return false;
+  }
+
+  // A first pass for the topic list, then back to the start
+  FlightLogReader::Record record;
+  while (reader.next(record))
+    ;
+  reader.seek(0);
+  bool imu_raw = false, depth_raw = false;
+  for (std::map<uint16_t, FlightLogTopic>::const_iterator it = reader.topics().begin(); it != reader.topics().end();
+       ++it)
+  {
+    imu_raw = imu_raw || (processors && it->second.name == "/imu/filter");
+    depth_raw = depth_raw || (processors && it->second.name == "/arduino/depth");
+  }
+
+  // The fixed-rate allocation loop runs on its own clock, so allocate on every command instead
+  double loop_rate;
+  nh.param<double>("thruster_controller/loop_rate", loop_rate, 0.0);
+  if (loop_rate > 0)
+    ROS_WARN("Control Replay: thruster_controller/loop_rate ignored, allocating on every command");
+  nh.setParam("thruster_controller/loop_rate", 0.0);
+
+  start.fromNSec(reader.chunkHeader(0).start);
+  ros::Time::setNow(start);
+  if (imu_raw)
+    imu_processor.reset(alignedNew<IMUProcessor>(argv));
+  if (depth_raw)
+    depth_processor.reset(alignedNew<DepthProcessor>());
+  depth_controller.reset(alignedNew<DepthController>());
+  attitude_controller.reset(alignedNew<AttitudeController>());
+  command_combinator.reset(alignedNew<CommandCombinator>());
+  thruster_controller.reset(alignedNew<ThrusterController>(argv, &listener));
+  pwm_controller.reset(alignedNew<PWMController>());
+  thrust_sub = nh.subscribe<riptide_msgs::ThrustStamped>("command/thrust", 10, &ControlReplay::thrustCB, this);
+  pwm_sub = nh.subscribe<riptide_msgs::PwmStamped>("command/pwm", 10, &ControlReplay::pwmCB, this);
+  buildRoutes(imu_raw, depth_raw);
+  next_output = next_watchdog = start;
+
+  if (!openOutput(output))
+    return false;
+  ROS_INFO("Control Replay: %s, %s IMU and %s depth", path.c_str(), imu_raw ? "raw" : "processed",
+           depth_raw ? "raw" : "processed");
+
+  ros::WallTime wall_start = ros::WallTime::now();
+  ros::Time t = start;
+  while (ros::ok() && reader.next(record))
+  {
+    t.fromNSec(record.stamp);
+    advanceTo(t);
+    ReplayRoute *r = findRoute(reader, record.topic);
+    if (!r)
+      continue;
+    r->deliver(record.data, record.length);
+    drain();
+    inputs++;
+  }
+  closeOutput();
+
+  double wall = (ros::WallTime::now() - wall_start).toSec();
+  double duration = (t - start).toSec();
+  ROS_INFO("Control Replay: %.1f s of log in %.2f s (%.0fx), %ld messages replayed, %ld thrust and %ld PWM out",
+           duration, wall, wall > 0 ? duration / wall : 0.0, inputs, thrust_count, pwm_count);
+  ROS_INFO("Control Replay: wrote %s_{thrust,pwm}{,_recorded}.csv", output.c_str());
+  return true;
+}
+
+static FILE *openCsv(const std::string &path, const char *header)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f)
+    ROS_ERROR("Control Replay: cannot create %s: %s", path.c_str(), strerror(errno));
+  else
+    fprintf(f, "%s\n", header);
+  return f;
+}
+
+#define THRUSTER_COLUMNS "surge_port_hi,surge_stbd_hi,surge_port_lo,surge_stbd_lo,sway_fwd,sway_aft," \
+                         "heave_port_fwd,heave_stbd_fwd,heave_port_aft,heave_stbd_aft"
+
+bool ControlReplay::openOutput(const std::string &prefix)
+{
+  thrust_csv = openCsv(prefix + "_thrust.csv", "time," THRUSTER_COLUMNS);
+  pwm_csv = openCsv(prefix + "_pwm.csv", "time," THRUSTER_COLUMNS);
+  recorded_thrust_csv = openCsv(prefix + "_thrust_recorded.csv", "time," THRUSTER_COLUMNS);
+  recorded_pwm_csv = openCsv(prefix + "_pwm_recorded.csv", "time," THRUSTER_COLUMNS);
+  return thrust_csv && pwm_csv && recorded_thrust_csv && recorded_pwm_csv;
+}
+
+void ControlReplay::closeOutput()
+{
+  FILE **files[] = { &thrust_csv, &pwm_csv, &recorded_thrust_csv, &recorded_pwm_csv };
+  for (int i = 0; i < 4; i++)
+  {
+    if (*files[i])
+      fclose(*files[i]);
+    *files[i] = 0;
+  }
+}
+
+static void writeThrust(FILE *f, const ros::Time &start, const riptide_msgs::ThrustStamped &thrust)
+{
+  const riptide_msgs::Thrust &t = thrust.force;
+  fprintf(f, "%.6f,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g\n", (thrust.header.stamp - start).toSec(), t.surge_port_hi,
+          t.surge_stbd_hi, t.surge_port_lo, t.surge_stbd_lo, t.sway_fwd, t.sway_aft, t.heave_port_fwd,
+          t.heave_stbd_fwd, t.heave_port_aft, t.heave_stbd_aft);
+}
+
+static void writePwm(FILE *f, const ros::Time &start, const riptide_msgs::PwmStamped &pwm)
+{
+  const riptide_msgs::Pwm &p = pwm.pwm;
+  fprintf(f, "%.6f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", (pwm.header.stamp - start).toSec(), p.surge_port_hi,
+          p.surge_stbd_hi, p.surge_port_lo, p.surge_stbd_lo, p.sway_fwd, p.sway_aft, p.heave_port_fwd,
+          p.heave_stbd_fwd, p.heave_port_aft, p.heave_stbd_aft);
+}
+
+void ControlReplay::thrustCB(const riptide_msgs::ThrustStamped::ConstPtr &thrust)
+{
+  writeThrust(thrust_csv, start, *thrust);
+  thrust_count++;
+}
+
+void ControlReplay::pwmCB(const riptide_msgs::PwmStamped::ConstPtr &pwm)
+{
+  writePwm(pwm_csv, start, *pwm);
+  pwm_count++;
+}
+
+void ControlReplay::recordedThrustCB(const riptide_msgs::ThrustStamped::ConstPtr &thrust)
+{
+  writeThrust(recorded_thrust_csv, start, *thrust);
+}
+
+void ControlReplay::recordedPwmCB(const riptide_msgs::PwmStamped::ConstPtr &pwm)
+{
+  writePwm(recorded_pwm_csv, start, *pwm);
+}
@@ -1,44 +1,44 @@
 #include "riptide_controllers/depth_controller.h"
+#include <boost/make_shared.hpp>
 
 #undef debug
 #undef report
 #undef progress
 
-int main(int argc, char **argv) {
-  ros::init(argc, argv, "depth_controller");
-  DepthController dc;
-  ros::spin();
-}
-
 void DepthController::UpdateError() {
   sample_duration = ros::Time::now() - sample_start;
   dt = sample_duration.toSec();
 
+  // Derivative on the estimated velocity from depth_processor rather than a
+  // difference of noisy errors; it also does not kick on command steps
   depth_error = current_depth - cmd_depth;
-  d_error = (depth_error - last_error) / dt;
-  last_error = depth_error;
+  d_error = current_velocity;
 
   accel.data = depth_controller_pid.computeCommand(depth_error, d_error, sample_duration);
 
-  cmd_pub.publish(accel);
+  cmd_pub.publish(boost::make_shared<std_msgs::Float64>(accel));
   sample_start = ros::Time::now();
 }
 
 
-DepthController::DepthController() {
-    ros::NodeHandle dcpid("depth_controller");
+DepthController::DepthController() : DepthController(ros::NodeHandle()) {
+}
+
+DepthController::DepthController(const ros::NodeHandle &node) : nh(node) {
+    ros::NodeHandle dcpid(nh, "depth_controller");
     cmd_sub = nh.subscribe<riptide_msgs::Depth>("command/depth", 1000, &DepthController::CommandCB, this);
-    depth_sub = nh.subscribe<riptide_msgs::Depth>("state/depth", 1000, &DepthController::DepthCB, this);
+    depth_sub = nh.subscribe<riptide_msgs::DepthState>("state/depth", 1000, &DepthController::DepthCB, this);
     kill_sub = nh.subscribe<riptide_msgs::SwitchState>("state/switches", 10, &DepthController::SwitchCB, this);
     depth_controller_pid.init(dcpid, false);
 
     cmd_pub = nh.advertise<std_msgs::Float64>("command/accel/linear/z", 1);
-    sample_start = ros::Time::now();
+    ResetController();
 }
 
 // Subscribe to command/depth
-void DepthController::DepthCB(const riptide_msgs::Depth::ConstPtr &depth) {
+void DepthController::DepthCB(const riptide_msgs::DepthState::ConstPtr &depth) {
   current_depth = depth->depth;
+  current_velocity = depth->velocity;
 
   if (!pid_initialized)
     cmd_depth = current_depth;
@@ -66,9 +66,9 @@ void DepthController::SwitchCB(const riptide_msgs::SwitchState::ConstPtr &state)
 void DepthController::ResetController() {
   depth_error = 0;
   current_depth = 0;
+  current_velocity = 0;
   cmd_depth = 0;
   d_error = 0;
-  last_error = 0;
   dt = 0;
 
   sample_start = ros::Time::now();
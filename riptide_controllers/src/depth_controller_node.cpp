@@ -0,0 +1,7 @@
+#include "riptide_controllers/depth_controller.h"
+
+int main(int argc, char **argv) {
+  ros::init(argc, argv, "depth_controller");
+  DepthController dc;
+  ros::spin();
+}
@@ -0,0 +1,18 @@
+// depth_controller as a nodelet, to share a manager with depth_processor
+
+#include "riptide_controllers/depth_controller.h"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+class DepthControllerNodelet : public nodelet::Nodelet
+{
+private:
+  boost::shared_ptr<DepthController> controller;
+
+  void onInit()
+  {
+    controller.reset(new DepthController(getNodeHandle()));
+  }
+};
+
+PLUGINLIB_EXPORT_CLASS(DepthControllerNodelet, nodelet::Nodelet)
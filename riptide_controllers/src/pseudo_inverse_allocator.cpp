@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "riptide_controllers/pseudo_inverse_allocator.h"
+
+// Small damping keeps the solve well-posed once too many thrusters saturate
+// to span all six axes
+#define DAMPING 1e-12
+
+PseudoInverseAllocator::PseudoInverseAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+                                               const ThrustVector &weights, const WarmStartOptions &warm)
+  : props(vehicle), geometry(thrusters), warm_start(warm)
+{
+  w_inv = weights.cwiseInverse();
+  rebuild();
+}
+
+void PseudoInverseAllocator::setAllocated(const bool allocated[NUM_THRUSTERS])
+{
+  std::copy(allocated, allocated + NUM_THRUSTERS, geometry.allocated);
+  rebuild();
+}
+
+void PseudoInverseAllocator::rebuild()
+{
+  A = buildAllocationMatrix(props, geometry);
+
+  // Unallocated thrusters have zero columns in A, so they get no share of the demand.
+  // A_pinv = W^-1 * A^T * (A * W^-1 * A^T)^-1
+  ThrustVector all_free = ThrustVector::Ones();
+  for (int i = 0; i < 6; i++)
+  {
+    ThrustVector col;
+    solveFree(Vector6d::Unit(i), all_free, col);
+    A_pinv.col(i) = col;
+  }
+
+  // The last solution may use a thruster that is now gone
+  last.valid = false;
+}
+
+// Minimum (weighted) norm solution of A * thrust = target using only the free thrusters
+void PseudoInverseAllocator::solveFree(const Vector6d &target, const ThrustVector &free_mask,
+                                       ThrustVector &thrust) const
+{
+  ThrustVector d = w_inv.cwiseProduct(free_mask);
+  AllocationMatrix AD = A * d.asDiagonal();
+  Eigen::Matrix<double, 6, 6> M = AD * A.transpose();
+  M.diagonal().array() += DAMPING;
+  thrust = AD.transpose() * M.ldlt().solve(target);
+}
+
+AllocationStats PseudoInverseAllocator::allocate(const Vector6d &cmd, const VehicleState &state,
+                                                 ThrustVector &thrust)
+{
+  AllocationStats stats;
+  Vector6d target = cmd - stateAcceleration(props, state);
+
+  // Nothing has changed enough to be worth solving again
+  if (warm_start.enabled && last.reusable(target, warm_start.tolerance))
+  {
+    thrust = last.thrust;
+    stats.saturated = countSaturated(props, geometry, thrust);
+    stats.residual = (A * thrust - target).norm();
+    return stats;
+  }
+
+  thrust.noalias() = A_pinv * target;
+  stats.iterations = 1;
+
+  ThrustVector free_mask;
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+    free_mask(i) = geometry.allocated[i] ? 1.0 : 0.0;
+
+  // Clamp saturated thrusters and hand their unmet demand to the free ones.
+  // Every pass removes at least one thruster, so this is bounded.
+  for (int pass = 0; pass < NUM_THRUSTERS; pass++)
+  {
+    bool clamped = false;
+    for (int i = 0; i < NUM_THRUSTERS; i++)
+    {
+      if (free_mask(i) == 0.0)
+        continue;
+      if (thrust(i) > props.max_thrust)
+      {
+        thrust(i) = props.max_thrust;
+        free_mask(i) = 0.0;
+        clamped = true;
+      }
+      else if (thrust(i) < props.min_thrust)
+      {
+        thrust(i) = props.min_thrust;
+        free_mask(i) = 0.0;
+        clamped = true;
+      }
+    }
+    if (!clamped || free_mask.sum() == 0.0)
+      break;
+
+    ThrustVector fixed = thrust.cwiseProduct(ThrustVector::Ones() - free_mask);
+    ThrustVector redistributed;
+    solveFree(target - A * fixed, free_mask, redistributed);
+    thrust = fixed + redistributed;
+    stats.iterations++;
+  }
+
+  stats.saturated = countSaturated(props, geometry, thrust);
+  stats.residual = (A * thrust - target).norm();
+
+  last.valid = true;
+  last.target = target;
+  last.thrust = thrust;
+  return stats;
+}
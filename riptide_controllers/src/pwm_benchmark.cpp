@@ -0,0 +1,114 @@
+// Thrust to PWM conversion benchmark. Runs without a ROS master.
+//
+// Usage: pwm_benchmark [messages]
+//
+// Converts random thrust messages with the original per-thruster scalar
+// conversion and with the batched thrustToPwm kernel, reports the time per
+// message for each, and checks that both give the same PWM. The trace is
+// converted repeatedly; it is long enough that the branch predictor cannot learn
+// it, as it cannot learn the signs of real thrust commands.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "riptide_controllers/thrust_to_pwm.h"
+
+// Original pwm_controller layout: [thruster][NEG_SLOPE, NEG_XINT, POS_SLOPE, POS_XINT]
+#define NEG_SLOPE 0
+#define NEG_XINT 1
+#define POS_SLOPE 2
+#define POS_XINT 3
+
+// Calibrated thrusters, with cfg/thruster_config.yaml values
+const int CHANNELS[8] = { SURGE_PORT_LO, SURGE_STBD_LO, SWAY_FWD, SWAY_AFT,
+                          HEAVE_PORT_FWD, HEAVE_STBD_FWD, HEAVE_PORT_AFT, HEAVE_STBD_AFT };
+const float CONFIG[8][4] = {
+  { -5.349046, 1527, -6.176643, 1477 }, { 5.234392, 1475, 6.393562, 1526 },   // SPL, SSL
+  { 5.161853, 1477, 6.621582, 1528 },   { -5.444654, 1529, -6.239471, 1479 }, // SWF, SWA
+  { -5.222560, 1529, -6.042335, 1476 }, { 5.159923, 1470, 6.277069, 1536 },   // HPF, HSF
+  { 4.886643, 1477, 6.449618, 1531 },   { -5.215345, 1524, -6.202313, 1474 }  // HPA, HSA
+};
+
+// PWMController::thrust2pwm before batching
+int scalarThrust2pwm(const float thrust_config[8][4], double raw_force, int thruster)
+{
+  int pwm = 1500;
+  if(raw_force < -0.01)
+  {
+    pwm = thrust_config[thruster][NEG_XINT] + static_cast<int>(raw_force*thrust_config[thruster][NEG_SLOPE]);
+  }
+  else if(raw_force > 0.01){
+    pwm = (int) (thrust_config[thruster][POS_XINT] + (raw_force*thrust_config[thruster][POS_SLOPE]));
+  }
+  else{
+    pwm = 1500;
+  }
+  return pwm;
+}
+
+int main(int argc, char **argv)
+{
+  int messages = argc > 1 ? atoi(argv[1]) : 20000;
+  const int repeats = 100;
+
+  PwmCalibration cal;
+  for (int k = 0; k < 8; k++)
+  {
+    int i = CHANNELS[k];
+    cal.neg_slope[i] = CONFIG[k][NEG_SLOPE];
+    cal.neg_xint[i] = CONFIG[k][NEG_XINT];
+    cal.pos_slope[i] = CONFIG[k][POS_SLOPE];
+    cal.pos_xint[i] = CONFIG[k][POS_XINT];
+  }
+
+  // Mix of dead band, small and saturated thrusts
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-8.0f, 8.0f);
+  std::vector<float> thrust(messages * NUM_THRUSTERS);
+  for (size_t i = 0; i < thrust.size(); i++)
+    thrust[i] = (i % 7 == 0) ? 0.005f : dist(rng);
+
+  std::vector<int> scalar(messages * NUM_THRUSTERS, 1500), batch(messages * NUM_THRUSTERS);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+  {
+    for (int m = 0; m < messages; m++)
+    {
+      const float *in = &thrust[m * NUM_THRUSTERS];
+      int *out = &scalar[m * NUM_THRUSTERS];
+      for (int k = 0; k < 8; k++)
+        out[CHANNELS[k]] = scalarThrust2pwm(CONFIG, in[CHANNELS[k]], k);
+    }
+  }
+  double scalar_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+  {
+    for (int m = 0; m < messages; m++)
+      thrustToPwm(cal, &thrust[m * NUM_THRUSTERS], &batch[m * NUM_THRUSTERS]);
+  }
+  double batch_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  long mismatches = 0;
+  for (int m = 0; m < messages; m++)
+  {
+    for (int k = 0; k < 8; k++)
+    {
+      int i = m * NUM_THRUSTERS + CHANNELS[k];
+      if (scalar[i] != batch[i])
+        mismatches++;
+    }
+  }
+
+  printf("%-10s %9s %11s\n", "path", "channels", "ns/message");
+  double conversions = static_cast<double>(messages) * repeats;
+  printf("%-10s %9d %11.2f\n", "scalar", 8, scalar_ns / conversions);
+  printf("%-10s %9d %11.2f\n", "batch", NUM_THRUSTERS, batch_ns / conversions);
+  printf("%ld of %ld calibrated channel conversions differ\n", mismatches, 8L * messages);
+  return mismatches == 0 ? 0 : 1;
+}
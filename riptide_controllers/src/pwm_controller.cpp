@@ -1,75 +1,74 @@
 #include "riptide_controllers/pwm_controller.h"
-#define SPL 0
-#define SSL 1
-#define SWA 2
-#define SWF 3
-#define HSF 4
-#define HSA 5
-#define HPA 6
-#define HPF 7
-#define NEG_SLOPE 0
-#define NEG_XINT 1
-#define POS_SLOPE 2
-#define POS_XINT 3
-
-int main(int argc, char** argv)
-{
-  ros::init(argc, argv, "pwm_controller");
-  PWMController pwm_controller;
-  pwm_controller.Loop();
-}
+#include <boost/make_shared.hpp>
+#include <math.h>
+
+// Calibration names, in Thruster order
+const char *const CALIBRATION_NAMES[NUM_THRUSTERS] = { "SPH", "SSH", "SPL", "SSL", "SWF",
+                                                       "SWA", "HPF", "HSF", "HPA", "HSA" };
 
 PWMController::PWMController() : nh()
 {
   cmd_sub = nh.subscribe<riptide_msgs::ThrustStamped>("command/thrust", 1, &PWMController::ThrustCB, this);
   kill_sub = nh.subscribe<riptide_msgs::SwitchState>("state/switches", 1, &PWMController::SwitchCB, this);
   pwm_pub = nh.advertise<riptide_msgs::PwmStamped>("command/pwm", 1);
+  diag_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+
+  // Two-segment linear calibration: the first segment is for negative forces, the second for positive.
+  // The surge_*_hi thrusters are not calibrated yet and stay at neutral until they are.
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    std::string name = std::string("/") + CALIBRATION_NAMES[i];
+    if ((i == SURGE_PORT_HI || i == SURGE_STBD_HI) && !nh.hasParam("pwm_controller" + name))
+    {
+      ROS_WARN("No calibration for %s, holding it at neutral", CALIBRATION_NAMES[i]);
+      continue;
+    }
+    load_calibration(calibration.neg_slope[i], name + "/NEG/SLOPE");
+    load_calibration(calibration.pos_slope[i], name + "/POS/SLOPE");
+    load_calibration(calibration.neg_xint[i], name + "/NEG/XINT");
+    load_calibration(calibration.pos_xint[i], name + "/POS/XINT");
+  }
 
-  //Initialization of the two trust/pwm slope arrays
-  //The first column is for negative forces, second column is positive force
-
-  // Surge Port Low
-  load_calibration(thrust_config[SPL][NEG_SLOPE], "/SPL/NEG/SLOPE");
-  load_calibration(thrust_config[SPL][POS_SLOPE], "/SPL/POS/SLOPE");
-  load_calibration(thrust_config[SPL][NEG_XINT], "/SPL/NEG/XINT");
-  load_calibration(thrust_config[SPL][POS_XINT], "/SPL/POS/XINT");
-
-  load_calibration(thrust_config[SSL][NEG_SLOPE], "/SSL/NEG/SLOPE");
-  load_calibration(thrust_config[SSL][POS_SLOPE], "/SSL/POS/SLOPE");
-  load_calibration(thrust_config[SSL][NEG_XINT], "/SSL/NEG/XINT");
-  load_calibration(thrust_config[SSL][POS_XINT], "/SSL/POS/XINT");
-
-  load_calibration(thrust_config[HPA][NEG_SLOPE], "/HPA/NEG/SLOPE");
-  load_calibration(thrust_config[HPA][POS_SLOPE], "/HPA/POS/SLOPE");
-  load_calibration(thrust_config[HPA][NEG_XINT], "/HPA/NEG/XINT");
-  load_calibration(thrust_config[HPA][POS_XINT], "/HPA/POS/XINT");
-
-  load_calibration(thrust_config[HPF][NEG_SLOPE], "/HPF/NEG/SLOPE");
-  load_calibration(thrust_config[HPF][POS_SLOPE], "/HPF/POS/SLOPE");
-  load_calibration(thrust_config[HPF][NEG_XINT], "/HPF/NEG/XINT");
-  load_calibration(thrust_config[HPF][POS_XINT], "/HPF/POS/XINT");
-
-  load_calibration(thrust_config[HSA][NEG_SLOPE], "/HSA/NEG/SLOPE");
-  load_calibration(thrust_config[HSA][POS_SLOPE], "/HSA/POS/SLOPE");
-  load_calibration(thrust_config[HSA][NEG_XINT], "/HSA/NEG/XINT");
-  load_calibration(thrust_config[HSA][POS_XINT], "/HSA/POS/XINT");
-
-  load_calibration(thrust_config[HSF][NEG_SLOPE], "/HSF/NEG/SLOPE");
-  load_calibration(thrust_config[HSF][POS_SLOPE], "/HSF/POS/SLOPE");
-  load_calibration(thrust_config[HSF][NEG_XINT], "/HSF/NEG/XINT");
-  load_calibration(thrust_config[HSF][POS_XINT], "/HSF/POS/XINT");
-
-  load_calibration(thrust_config[SWF][NEG_SLOPE], "/SWF/NEG/SLOPE");
-  load_calibration(thrust_config[SWF][POS_SLOPE], "/SWF/POS/SLOPE");
-  load_calibration(thrust_config[SWF][NEG_XINT], "/SWF/NEG/XINT");
-  load_calibration(thrust_config[SWF][POS_XINT], "/SWF/POS/XINT");
-
-  load_calibration(thrust_config[SWA][NEG_SLOPE], "/SWA/NEG/SLOPE");
-  load_calibration(thrust_config[SWA][POS_SLOPE], "/SWA/POS/SLOPE");
-  load_calibration(thrust_config[SWA][NEG_XINT], "/SWA/NEG/XINT");
-  load_calibration(thrust_config[SWA][POS_XINT], "/SWA/POS/XINT");
-
-  alive_timeout = ros::Duration(2);
+  // Forces inside the dead band give neutral PWM; the output never leaves the ESC range
+  nh.param<float>("pwm_controller/DEAD_BAND", calibration.dead_band, calibration.dead_band);
+  nh.param<int>("pwm_controller/PWM_MIN", calibration.pwm_min, calibration.pwm_min);
+  nh.param<int>("pwm_controller/PWM_MAX", calibration.pwm_max, calibration.pwm_max);
+
+  // Fitted lookup tables, where scripts/thrust_calibration.py produced one
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (load_lut(thrust_lut[i], CALIBRATION_NAMES[i]))
+      ROS_INFO("%s: using thrust lookup table (%d entries)", CALIBRATION_NAMES[i], (int)thrust_lut[i].pwm.size());
+  }
+
+  // Slew rate limit for every thruster, which each may override
+  float default_slew;
+  nh.param<float>("pwm_controller/SLEW_RATE", default_slew, 2000);
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    nh.param<float>(std::string("pwm_controller/") + CALIBRATION_NAMES[i] + "/SLEW_RATE", slew_rate[i], default_slew);
+    target_pwm[i] = output_pwm[i] = PWM_NEUTRAL;
+  }
+  nh.param<double>("pwm_controller/OUTPUT_RATE", output_rate, 50);
+  nh.param<double>("pwm_controller/SOFT_START", soft_start, 2.0);
+  if (output_rate <= 0)
+  {
+    ROS_WARN("OUTPUT_RATE must be positive, using 50 Hz");
+    output_rate = 50;
+  }
+
+  // Watchdog on the command stream, and the neutral heartbeat while stopped
+  double timeout, heartbeat_rate;
+  nh.param<double>("pwm_controller/ALIVE_TIMEOUT", timeout, 2.0);
+  nh.param<double>("pwm_controller/WATCHDOG_PERIOD", watchdog_period, 0.005);
+  nh.param<double>("pwm_controller/HEARTBEAT_RATE", heartbeat_rate, 1.0);
+  if (watchdog_period <= 0)
+  {
+    ROS_WARN("WATCHDOG_PERIOD must be positive, using 5 ms");
+    watchdog_period = 0.005;
+  }
+  alive_timeout = ros::Duration(timeout);
+  heartbeat_period = ros::Duration(heartbeat_rate > 0 ? 1.0 / heartbeat_rate : 1.0);
   last_alive_time = ros::Time::now();
   silent = false; // Silent refers to not receiving commands from the control stack
   dead = true; // Dead refers to the kill switch being pulled
@@ -79,20 +78,27 @@ void PWMController::ThrustCB(const riptide_msgs::ThrustStamped::ConstPtr& thrust
 {
   if (!dead)
   {
-    msg.header.stamp = thrust->header.stamp;
+    target_stamp = thrust->header.stamp;
 
-    msg.pwm.surge_port_lo = thrust2pwm(thrust->force.surge_port_lo, SPL);
-    msg.pwm.surge_stbd_lo = thrust2pwm(thrust->force.surge_stbd_lo, SSL);
+    const riptide_msgs::Thrust &f = thrust->force;
+    float force[NUM_THRUSTERS] = { f.surge_port_hi, f.surge_stbd_hi, f.surge_port_lo, f.surge_stbd_lo, f.sway_fwd,
+                                   f.sway_aft, f.heave_port_fwd, f.heave_stbd_fwd, f.heave_port_aft, f.heave_stbd_aft };
+    int pwm[NUM_THRUSTERS];
+    thrustToPwm(calibration, force, pwm);
 
-    msg.pwm.sway_fwd = thrust2pwm(thrust->force.sway_fwd, SWF);
-    msg.pwm.sway_aft = thrust2pwm(thrust->force.sway_aft, SWA);
-
-    msg.pwm.heave_stbd_fwd = thrust2pwm(thrust->force.heave_stbd_fwd, HSF);
-    msg.pwm.heave_stbd_aft = thrust2pwm(thrust->force.heave_stbd_aft, HSA);
+    // Thrusters with a fitted table use it instead of the linear calibration,
+    // with the same dead band and ESC range, whatever the table's edges hold
+    for (int i = 0; i < NUM_THRUSTERS; i++)
+    {
+      if (thrust_lut[i].pwm.empty())
+        continue;
+      int p = fabs(force[i]) > calibration.dead_band ? lookup(thrust_lut[i], force[i]) : PWM_NEUTRAL;
+      pwm[i] = std::min(std::max(p, calibration.pwm_min), calibration.pwm_max);
+    }
 
-    msg.pwm.heave_port_aft = thrust2pwm(thrust->force.heave_port_aft, HPA);
-    msg.pwm.heave_port_fwd = thrust2pwm(thrust->force.heave_port_fwd, HPF);
-    pwm_pub.publish(msg);
+    // Published by the output stage
+    for (int i = 0; i < NUM_THRUSTERS; i++)
+      target_pwm[i] = pwm[i];
     last_alive_time = ros::Time::now();
     silent = false;
   }
@@ -100,68 +106,163 @@ void PWMController::ThrustCB(const riptide_msgs::ThrustStamped::ConstPtr& thrust
 
 void PWMController::SwitchCB(const riptide_msgs::SwitchState::ConstPtr &state)
 {
+  bool was_dead = dead;
   dead = !state->kill;
+
+  // Soft start from the moment the kill switch goes in
+  if (was_dead && !dead)
+    armed_time = ros::Time::now();
+  // Stop at once when it is pulled, rather than on the next output cycle
+  if (!was_dead && dead)
+    PublishZeroPWM();
 }
 
-void PWMController::Loop()
+// Trips the failsafe as soon as the command stream has been quiet for alive_timeout
+void PWMController::WatchdogCB(const ros::TimerEvent &event)
 {
-  ros::Rate rate(10);
-  while (ros::ok())
-  {
-    ros::spinOnce();
-    ros::Duration quiet_time = ros::Time::now() - last_alive_time;
-    if (quiet_time >= alive_timeout)
-    {
-      silent = true;
-    }
+  watchdog_stats.checks++;
+  double jitter = (event.current_real - event.current_expected).toSec();
+  watchdog_stats.jitter_sum += jitter;
+  watchdog_stats.jitter_max = std::max(watchdog_stats.jitter_max, jitter);
 
-    if (silent || dead)
+  ros::Duration quiet_time = ros::Time::now() - last_alive_time;
+  if (!silent && quiet_time >= alive_timeout)
+  {
+    silent = true;
+    if (!dead)
     {
-      PWMController::PublishZeroPWM();
+      PublishZeroPWM();
+      double latency = (quiet_time - alive_timeout).toSec();
+      watchdog_stats.trips++;
+      watchdog_stats.latency_sum += latency;
+      watchdog_stats.latency_max = std::max(watchdog_stats.latency_max, latency);
+      ROS_WARN("No thrust command for %.3f s, stopping thrusters", quiet_time.toSec());
     }
-    rate.sleep();
   }
 }
 
-int PWMController::thrust2pwm(double raw_force, int thruster)
+void PWMController::OutputCB(const ros::TimerEvent &event)
 {
-  int pwm = 1500;
-  // If force is negative, use negative calibration.
-  // If force is positive, use positive calibration
-  // Otherwise, set PWM to 1500 (0 thrust)
-  if(raw_force < -0.01)
+  if (!silent && !dead)
+    PublishOutput();
+  else if (ros::Time::now() - last_zero_time >= heartbeat_period)
+    PublishZeroPWM(); // Heartbeat, so the thruster board still hears from us while stopped
+}
+
+void PWMController::DiagnosticsCB(const ros::TimerEvent &event)
+{
+  WatchdogStats window = watchdog_stats;
+  watchdog_stats.reset();
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = "pwm_controller: watchdog";
+  status.hardware_id = "pwm_controller";
+  status.level = silent && !dead ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = dead ? "killed" : silent ? "no thrust command" : "running";
+
+  std::vector<std::pair<std::string, double> > values;
+  values.push_back(std::make_pair("timeout [s]", alive_timeout.toSec()));
+  values.push_back(std::make_pair("period [ms]", 1e3 * watchdog_period));
+  values.push_back(std::make_pair("checks", window.checks));
+  values.push_back(std::make_pair("jitter mean [us]", window.checks ? 1e6 * window.jitter_sum / window.checks : 0.0));
+  values.push_back(std::make_pair("jitter max [us]", 1e6 * window.jitter_max));
+  values.push_back(std::make_pair("trips", window.trips));
+  values.push_back(std::make_pair("detection latency mean [ms]",
+                                  window.trips ? 1e3 * window.latency_sum / window.trips : 0.0));
+  values.push_back(std::make_pair("detection latency max [ms]", 1e3 * window.latency_max));
+  for (size_t i = 0; i < values.size(); i++)
   {
-    pwm = thrust_config[thruster][NEG_XINT] + static_cast<int>(raw_force*thrust_config[thruster][NEG_SLOPE]);
+    diagnostic_msgs::KeyValue kv;
+    kv.key = values[i].first;
+    kv.value = std::to_string(values[i].second);
+    status.values.push_back(kv);
   }
-  else if(raw_force > 0.01){
-    pwm = (int) (thrust_config[thruster][POS_XINT] + (raw_force*thrust_config[thruster][POS_SLOPE]));
-  }
-  else{
-    pwm = 1500;
+
+  diagnostic_msgs::DiagnosticArray diag;
+  diag.header.stamp = ros::Time::now();
+  diag.status.push_back(status);
+  diag_pub.publish(diag);
+}
+
+// Output, watchdog and diagnostics all run from timers on this thread, so
+// callbacks never overlap and the watchdog is checked every watchdog_period
+void PWMController::Loop()
+{
+  output_timer = nh.createTimer(ros::Duration(1.0 / output_rate), &PWMController::OutputCB, this);
+  watchdog_timer = nh.createTimer(ros::Duration(watchdog_period), &PWMController::WatchdogCB, this);
+  diag_timer = nh.createTimer(ros::Duration(1.0), &PWMController::DiagnosticsCB, this);
+  PublishZeroPWM();
+  ros::spin();
+}
+
+// Linear interpolation between table entries, clamped to the calibrated range
+int PWMController::lookup(const ThrustLUT &lut, double raw_force)
+{
+  int last = lut.pwm.size() - 1;
+  double x = (raw_force - lut.thrust_min) / lut.thrust_step;
+  x = std::min(std::max(x, 0.0), static_cast<double>(last));
+  int i = std::min(static_cast<int>(x), last - 1);
+  return lut.pwm[i] + static_cast<int>((x - i) * (lut.pwm[i + 1] - lut.pwm[i]));
+}
+
+// Moves the output towards the latest command at the slew rate limit. During
+// the soft start the command's offset from neutral is scaled up from zero.
+void PWMController::PublishOutput()
+{
+  float ramp = 1;
+  if (soft_start > 0)
+    ramp = std::min((ros::Time::now() - armed_time).toSec() / soft_start, 1.0);
+
+  float target[NUM_THRUSTERS], max_step[NUM_THRUSTERS];
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    target[i] = PWM_NEUTRAL + ramp * (target_pwm[i] - PWM_NEUTRAL);
+    max_step[i] = slew_rate[i] / output_rate;
   }
-  return pwm;
+  slewPwm(target, max_step, output_pwm);
+
+  int pwm[NUM_THRUSTERS];
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+    pwm[i] = static_cast<int>(output_pwm[i] + 0.5f);
+
+  msg.header.stamp = target_stamp;
+  SetPWM(pwm);
+  pwm_pub.publish(boost::make_shared<riptide_msgs::PwmStamped>(msg));
+}
+
+void PWMController::SetPWM(const int pwm[NUM_THRUSTERS])
+{
+  msg.pwm.surge_port_hi = pwm[SURGE_PORT_HI];
+  msg.pwm.surge_stbd_hi = pwm[SURGE_STBD_HI];
+  msg.pwm.surge_port_lo = pwm[SURGE_PORT_LO];
+  msg.pwm.surge_stbd_lo = pwm[SURGE_STBD_LO];
+  msg.pwm.sway_fwd = pwm[SWAY_FWD];
+  msg.pwm.sway_aft = pwm[SWAY_AFT];
+  msg.pwm.heave_port_fwd = pwm[HEAVE_PORT_FWD];
+  msg.pwm.heave_stbd_fwd = pwm[HEAVE_STBD_FWD];
+  msg.pwm.heave_port_aft = pwm[HEAVE_PORT_AFT];
+  msg.pwm.heave_stbd_aft = pwm[HEAVE_STBD_AFT];
 }
 
+// Stopping is never slew limited; the output restarts from neutral
 void PWMController::PublishZeroPWM()
 {
   msg.header.stamp = ros::Time::now();
+  last_zero_time = msg.header.stamp;
+  std::fill(output_pwm, output_pwm + NUM_THRUSTERS, PWM_NEUTRAL);
+  std::fill(target_pwm, target_pwm + NUM_THRUSTERS, PWM_NEUTRAL);
 
-  msg.pwm.surge_port_lo = 1500;
-  msg.pwm.surge_stbd_lo = 1500;
-  msg.pwm.sway_fwd = 1500;
-  msg.pwm.sway_aft = 1500;
-  msg.pwm.heave_stbd_fwd = 1500;
-  msg.pwm.heave_stbd_aft = 1500;
-  msg.pwm.heave_port_aft = 1500;
-  msg.pwm.heave_port_fwd = 1500;
-  pwm_pub.publish(msg);
+  int neutral[NUM_THRUSTERS];
+  std::fill(neutral, neutral + NUM_THRUSTERS, PWM_NEUTRAL);
+  SetPWM(neutral);
+  pwm_pub.publish(boost::make_shared<riptide_msgs::PwmStamped>(msg));
 }
 
 void PWMController::load_calibration(float &param, std::string name)
 {
   try
   {
-    if (!nh.getParam("/pwm_controller/" + name, param))
+    if (!nh.getParam("pwm_controller/" + name, param))
     {
       throw 0;
     }
@@ -172,3 +273,19 @@ void PWMController::load_calibration(float &param, std::string name)
     ros::shutdown();
   }
 }
+
+bool PWMController::load_lut(ThrustLUT &lut, std::string name)
+{
+  std::string prefix = "pwm_controller/" + name + "/LUT/";
+  std::vector<int> pwm;
+  if (!nh.getParam(prefix + "PWM", pwm))
+    return false;
+  if (pwm.size() < 2 || !nh.getParam(prefix + "THRUST_MIN", lut.thrust_min) ||
+      !nh.getParam(prefix + "THRUST_STEP", lut.thrust_step) || lut.thrust_step <= 0)
+  {
+    ROS_ERROR("Invalid thrust lookup table for %s, using the linear calibration", name.c_str());
+    return false;
+  }
+  lut.pwm = pwm;
+  return true;
+}
@@ -0,0 +1,8 @@
+#include "riptide_controllers/pwm_controller.h"
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "pwm_controller");
+  PWMController pwm_controller;
+  pwm_controller.Loop();
+}
@@ -0,0 +1,159 @@
+#include "riptide_controllers/qp_allocator.h"
+
+#include <algorithm>
+
+// Steps shorter than this (N) count as having reached the subproblem minimum
+#define STEP_TOLERANCE 1e-9
+
+QPAllocator::QPAllocator(const VehicleProperties &vehicle, const ThrusterGeometry &thrusters,
+                         const ThrustVector &weights, const QPOptions &qp, const WarmStartOptions &warm)
+  : props(vehicle), geometry(thrusters), power(weights), options(qp), warm_start(warm)
+{
+  previous.setZero();
+  rebuild();
+}
+
+void QPAllocator::setAllocated(const bool allocated[NUM_THRUSTERS])
+{
+  std::copy(allocated, allocated + NUM_THRUSTERS, geometry.allocated);
+  rebuild();
+}
+
+void QPAllocator::rebuild()
+{
+  A = buildAllocationMatrix(props, geometry);
+
+  // Hessian of the objective (the factor 2 is dropped throughout)
+  H = options.tracking_weight * A.transpose() * A;
+  H.diagonal() += options.power_weight * power + options.rate_weight * ThrustVector::Ones();
+
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    active[i] = geometry.allocated[i] ? FREE : FIXED;
+    if (!geometry.allocated[i])
+      previous(i) = 0.0;
+  }
+  last.valid = false;
+}
+
+// Minimizes the objective over the free thrusters, with the others held where they are in u
+void QPAllocator::solveActive(const ThrustVector &g, const ThrustVector &u, ThrustVector &u_star) const
+{
+  Hessian K = H;
+  ThrustVector rhs = -g;
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (active[i] == FREE)
+      continue;
+    // Move the known value to the right hand side and pin the row to it
+    rhs -= K.col(i) * u(i);
+    K.row(i).setZero();
+    K.col(i).setZero();
+    K(i, i) = 1.0;
+  }
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (active[i] != FREE)
+      rhs(i) = u(i);
+  }
+  u_star = K.ldlt().solve(rhs);
+}
+
+AllocationStats QPAllocator::allocate(const Vector6d &cmd, const VehicleState &state, ThrustVector &thrust)
+{
+  AllocationStats stats;
+  Vector6d target = cmd - stateAcceleration(props, state);
+
+  // Nothing has changed enough to be worth solving again
+  if (warm_start.enabled && last.reusable(target, warm_start.tolerance))
+  {
+    thrust = last.thrust;
+    stats.saturated = countSaturated(props, geometry, thrust);
+    stats.residual = (A * thrust - target).norm();
+    return stats;
+  }
+
+  // Linear term of the objective
+  ThrustVector g = -options.tracking_weight * A.transpose() * target - options.rate_weight * previous;
+
+  // The previous thrust, with the active set it finished on, is a feasible start
+  // that is usually one or two active-set changes away from the new optimum
+  ThrustVector u = previous;
+  ThrustVector u_star;
+
+  for (int iter = 0; iter < options.max_iterations; iter++)
+  {
+    stats.iterations++;
+    solveActive(g, u, u_star);
+    ThrustVector step = u_star - u;
+
+    if (step.cwiseAbs().maxCoeff() < STEP_TOLERANCE)
+    {
+      // Stationary on this active set: release the bound that most wants to move inwards
+      ThrustVector gradient = H * u + g;
+      int release = -1;
+      double worst = 0.0;
+      for (int i = 0; i < NUM_THRUSTERS; i++)
+      {
+        double pull = active[i] == LOWER ? -gradient(i) : active[i] == UPPER ? gradient(i) : 0.0;
+        if (pull > worst)
+        {
+          worst = pull;
+          release = i;
+        }
+      }
+      if (release < 0)
+        break; // KKT conditions hold
+      active[release] = FREE;
+      continue;
+    }
+
+    // Step towards the subproblem minimum until the first bound gets in the way
+    double alpha = 1.0;
+    int blocking = -1;
+    Bound blocked_at = FREE;
+    for (int i = 0; i < NUM_THRUSTERS; i++)
+    {
+      if (active[i] != FREE)
+        continue;
+      if (u_star(i) > props.max_thrust && step(i) > 0)
+      {
+        double a = (props.max_thrust - u(i)) / step(i);
+        if (a < alpha)
+        {
+          alpha = a;
+          blocking = i;
+          blocked_at = UPPER;
+        }
+      }
+      else if (u_star(i) < props.min_thrust && step(i) < 0)
+      {
+        double a = (props.min_thrust - u(i)) / step(i);
+        if (a < alpha)
+        {
+          alpha = a;
+          blocking = i;
+          blocked_at = LOWER;
+        }
+      }
+    }
+
+    u += alpha * step;
+    if (blocking >= 0)
+    {
+      u(blocking) = blocked_at == UPPER ? props.max_thrust : props.min_thrust;
+      active[blocking] = blocked_at;
+    }
+  }
+
+  thrust = u;
+  previous = u;
+
+  stats.saturated = countSaturated(props, geometry, thrust);
+  stats.residual = (A * thrust - target).norm();
+
+  last.valid = true;
+  last.target = target;
+  last.thrust = thrust;
+  return stats;
+}
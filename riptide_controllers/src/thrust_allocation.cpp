@@ -0,0 +1,104 @@
+#include "riptide_controllers/thrust_allocation.h"
+
+const char *const THRUSTER_NAMES[NUM_THRUSTERS] = {
+  "surge_port_hi", "surge_stbd_hi", "surge_port_lo", "surge_stbd_lo", "sway_fwd",
+  "sway_aft", "heave_port_fwd", "heave_stbd_fwd", "heave_port_aft", "heave_stbd_aft"
+};
+
+VehicleProperties::VehicleProperties()
+{
+  // Vehicle mass (kg):
+  // TODO: Get this value from model
+  mass = 33.5;
+
+  // Vehcile volume (m^3)
+  // TODO: Get this value from model
+  // Updated on 2/21/18
+  volume = 0.0340;
+
+  gravity = 9.81;
+  water_density = 1000.0;
+  buoyancy = volume * water_density * gravity;
+
+  // Moments of inertia (kg*m^2)
+  Ixx = 0.52607145;
+  Iyy = 1.50451601;
+  Izz = 1.62450600;
+
+  // Thrust limits (N):
+  min_thrust = -8.0;
+  max_thrust = 8.0;
+}
+
+ThrusterGeometry::ThrusterGeometry()
+{
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    position[i].setZero();
+    allocated[i] = true;
+  }
+
+  // Surge thrusters push along x, sway along y, heave along z
+  for (int i = SURGE_PORT_HI; i <= SURGE_STBD_LO; i++)
+    direction[i] = Eigen::Vector3d::UnitX();
+  for (int i = SWAY_FWD; i <= SWAY_AFT; i++)
+    direction[i] = Eigen::Vector3d::UnitY();
+  for (int i = HEAVE_PORT_FWD; i <= HEAVE_STBD_AFT; i++)
+    direction[i] = Eigen::Vector3d::UnitZ();
+}
+
+VehicleState::VehicleState()
+{
+  R_wRelb.setIdentity();
+  ang_v.setZero();
+  buoyant = false;
+}
+
+AllocationMatrix buildAllocationMatrix(const VehicleProperties &props, const ThrusterGeometry &geometry)
+{
+  AllocationMatrix A;
+  Eigen::Vector3d inertia(props.Ixx, props.Iyy, props.Izz);
+
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (!geometry.allocated[i])
+    {
+      A.col(i).setZero();
+      continue;
+    }
+
+    // Force over mass, and moment (r x F) over inertia
+    A.col(i).head<3>() = geometry.direction[i] / props.mass;
+    A.col(i).tail<3>() = geometry.position[i].cross(geometry.direction[i]).cwiseQuotient(inertia);
+  }
+  return A;
+}
+
+Vector6d stateAcceleration(const VehicleProperties &props, const VehicleState &state)
+{
+  Vector6d a;
+  double net_weight = state.buoyant ? (props.buoyancy - props.mass * props.gravity) : 0.0;
+  const Eigen::Vector3d &w = state.ang_v;
+
+  // Net buoyancy acts along world z, expressed in the body frame
+  a.head<3>() = state.R_wRelb.col(2) * net_weight / props.mass;
+
+  // Gyroscopic terms of Euler's equations
+  a(3) = (props.Iyy - props.Izz) * w.y() * w.z() / props.Ixx;
+  a(4) = (props.Izz - props.Ixx) * w.x() * w.z() / props.Iyy;
+  a(5) = (props.Ixx - props.Iyy) * w.x() * w.y() / props.Izz;
+  return a;
+}
+
+int countSaturated(const VehicleProperties &props, const ThrusterGeometry &geometry, const ThrustVector &thrust)
+{
+  const double tol = 1e-6;
+  int n = 0;
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (geometry.allocated[i] &&
+        (thrust(i) <= props.min_thrust + tol || thrust(i) >= props.max_thrust - tol))
+      n++;
+  }
+  return n;
+}
@@ -0,0 +1,47 @@
+#include "riptide_controllers/thrust_to_pwm.h"
+
+#include <math.h>
+
+PwmCalibration::PwmCalibration()
+{
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    neg_slope[i] = pos_slope[i] = 0.0f;
+    neg_xint[i] = pos_xint[i] = PWM_NEUTRAL;
+  }
+  dead_band = 0.01f;
+  pwm_min = 1100;
+  pwm_max = 1900;
+}
+
+void thrustToPwm(const PwmCalibration &cal, const float thrust[NUM_THRUSTERS], int pwm[NUM_THRUSTERS])
+{
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    // Products in double and integer truncation round exactly like the scalar version
+    float f = thrust[i];
+    double fd = f;
+
+    // Both segments are always evaluated and blended with 0/1 masks. A ternary
+    // between them would stay a branch, since the float to int conversions may trap.
+    int neg = static_cast<int>(cal.neg_xint[i]) + static_cast<int>(fd * cal.neg_slope[i]);
+    int pos = static_cast<int>(cal.pos_xint[i] + fd * cal.pos_slope[i]);
+    int is_neg = f < 0.0f;
+    int active = fabsf(f) > cal.dead_band;
+    int p = is_neg * neg + (1 - is_neg) * pos;
+    p = active * p + (1 - active) * PWM_NEUTRAL;
+
+    p = p < cal.pwm_min ? cal.pwm_min : p;
+    pwm[i] = p > cal.pwm_max ? cal.pwm_max : p;
+  }
+}
+
+void slewPwm(const float target[NUM_THRUSTERS], const float max_step[NUM_THRUSTERS], float pwm[NUM_THRUSTERS])
+{
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    float step = target[i] - pwm[i];
+    step = step < -max_step[i] ? -max_step[i] : step;
+    pwm[i] += step > max_step[i] ? max_step[i] : step;
+  }
+}
@@ -1,401 +1,604 @@
-#include "riptide_controllers/thruster_controller.h"
-
-#undef debug
-#undef report
-#undef progress
-
-//Rotation Matrices: world relative to body, and body relative to world
-tf::Matrix3x3 R_wRelb, R_bRelw;
-tf::Vector3 ang_v;
-
-#define PI 3.141592653
-
-// Thrust limits (N):
-double MIN_THRUST = -8.0;
-double MAX_THRUST = 8.0;
-
-// Vehicle mass (kg):
-// TODO: Get this value from model
-double MASS = 33.5;
-
-// Vehcile volume (m^3)
-// TODO: Get this value from model
-// Updated on 2/21/18
-double VOLUME = 0.0340;
-
-// Gravity (m/s^2)
-double GRAVITY = 9.81;
-
-// Water density (kg/m^3)
-double WATER_DENSITY = 1000.0;
-double BUOYANCY = VOLUME * WATER_DENSITY * GRAVITY;
-
-// Moments of inertia (kg*m^2)
-double Ixx = 0.52607145;
-double Iyy = 1.50451601;
-double Izz = 1.62450600;
-
-// Acceleration commands (m/s^):
-double cmdSurge = 0.0;
-double cmdSway = 0.0;
-double cmdHeave = 0.0;
-double cmdRoll = 0.0;
-double cmdPitch = 0.0;
-double cmdYaw = 0.0;
-
-//BUOYANCY Boolean  <-
-bool isBuoyant = false;
-
-struct vector
-{
-  double x;
-  double y;
-  double z;
-};
-
-void get_transform(vector *v, tf::StampedTransform *tform)
-{
-  v->x = tform->getOrigin().x();
-  v->y = tform->getOrigin().y();
-  v->z = tform->getOrigin().z();
-  return;
-}
-
-/*** Thruster Positions ***/
-// Positions are in meters relative to the center of mass.
-vector pos_surge_stbd_hi;
-vector pos_surge_port_hi;
-vector pos_surge_port_lo;
-vector pos_surge_stbd_lo;
-vector pos_sway_fwd;
-vector pos_sway_aft;
-vector pos_heave_port_aft;
-vector pos_heave_stbd_aft;
-vector pos_heave_stbd_fwd;
-vector pos_heave_port_fwd;
-
-/*** EQUATIONS ***/
-// These equations solve for linear/angular acceleration in all axes
-
-// Linear Equations
-struct surge
-{
-  template <typename T>
-  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
-                  const T *const surge_stbd_lo, const T *const sway_fwd, const T *const sway_aft,
-                  const T *const heave_port_fwd, const T *const heave_stbd_fwd, const T *const heave_port_aft,
-                  const T *const heave_stbd_aft, T *residual) const
-  {
-    residual[0] =
-        ((surge_port_lo[0] + surge_stbd_lo[0]) +
-          (R_wRelb.getRow(0).z() * (T(BUOYANCY) - T(MASS) * T(GRAVITY))*T(isBuoyant))) /
-            T(MASS) -
-        T(cmdSurge);
-    return true;
-  }
-};
-
-struct sway
-{
-  template <typename T>
-  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
-                  const T *const surge_stbd_lo, const T *const sway_fwd, const T *const sway_aft,
-                  const T *const heave_port_fwd, const T *const heave_stbd_fwd, const T *const heave_port_aft,
-                  const T *const heave_stbd_aft, T *residual) const
-  {
-    residual[0] =
-        ((sway_fwd[0] + sway_aft[0]) +
-         (R_wRelb.getRow(1).z() * (T(BUOYANCY) - T(MASS) * T(GRAVITY))*T(isBuoyant))) /
-            T(MASS) -
-        T(cmdSway);
-    return true;
-  }
-};
-
-struct heave
-{
-  template <typename T>
-  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
-                  const T *const surge_stbd_lo, const T *const sway_fwd, const T *const sway_aft,
-                  const T *const heave_port_fwd, const T *const heave_stbd_fwd, const T *const heave_port_aft,
-                  const T *const heave_stbd_aft, T *residual) const
-  {
-
-      residual[0] =
-          ((heave_port_fwd[0] + heave_port_aft[0] + heave_stbd_fwd[0] + heave_stbd_aft[0]) +
-           (R_wRelb.getRow(2).z() * (T(BUOYANCY) - T(MASS) * T(GRAVITY))*T(isBuoyant))) /
-           T(MASS) -
-           T(cmdHeave);
-    return true;
-  }
-};
-
-// Angular equations
-struct roll
-{
-  template <typename T>
-  bool operator()(const T *const sway_fwd, const T *const sway_aft, const T *const heave_port_fwd,
-                  const T *const heave_stbd_fwd, const T *const heave_port_aft, const T *const heave_stbd_aft,
-                  T *residual) const
-  {
-    residual[0] = (heave_port_fwd[0] * T(pos_heave_port_fwd.y) + heave_stbd_fwd[0] * T(pos_heave_stbd_fwd.y) +
-                   heave_port_aft[0] * T(pos_heave_port_aft.y) + heave_stbd_aft[0] * T(pos_heave_stbd_aft.y) -
-                   (sway_fwd[0] * T(pos_sway_fwd.z) + sway_aft[0] * T(pos_sway_aft.z)) +
-                   T(Iyy) * T(ang_v.y()) * T(ang_v.z()) - T(Izz) * T(ang_v.y()) * T(ang_v.z())) /
-                      T(Ixx) -
-                  T(cmdRoll);
-    return true;
-  }
-};
-
-struct pitch
-{
-  template <typename T>
-  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
-                  const T *const surge_stbd_lo, const T *const heave_port_fwd, const T *const heave_stbd_fwd,
-                  const T *const heave_port_aft, const T *const heave_stbd_aft, T *residual) const
-  {
-    residual[0] = (/*surge_port_hi[0] * T(pos_surge_port_hi.z) + surge_stbd_hi[0] * T(pos_surge_stbd_hi.z) +*/
-                   surge_port_lo[0] * T(pos_surge_port_lo.z) + surge_stbd_lo[0] * T(pos_surge_stbd_lo.z) +
-                   heave_port_fwd[0] * T(-pos_heave_port_fwd.x) + heave_stbd_fwd[0] * T(-pos_heave_stbd_fwd.x) +
-                   heave_port_aft[0] * T(-pos_heave_port_aft.x) + heave_stbd_aft[0] * T(-pos_heave_stbd_aft.x) +
-                   T(Izz) * T(ang_v.x()) * T(ang_v.z()) - T(Ixx) * T(ang_v.x()) * T(ang_v.z())) /
-                      T(Iyy) -
-                  T(cmdPitch);
-    return true;
-  }
-};
-
-struct yaw
-{
-  template <typename T>
-  bool operator()(const T *const surge_port_hi, const T *const surge_stbd_hi, const T *const surge_port_lo,
-                  const T *const surge_stbd_lo, const T *const sway_fwd, const T *const sway_aft, T *residual) const
-  {
-    residual[0] = (/*surge_port_hi[0] * T(-pos_surge_port_hi.y) + surge_stbd_hi[0] * T(-pos_surge_stbd_hi.y) +*/
-                   surge_port_lo[0] * T(-pos_surge_port_lo.y) + surge_stbd_lo[0] * T(-pos_surge_stbd_lo.y) +
-                   sway_fwd[0] * T(pos_sway_fwd.x) + sway_aft[0] * T(pos_sway_aft.x) +
-                   T(Ixx) * T(ang_v.x()) * T(ang_v.y()) - T(Iyy) * T(ang_v.x()) * T(ang_v.y())) /
-                      T(Izz) -
-                  T(cmdYaw);
-    return true;
-  }
-};
-
-int main(int argc, char **argv)
-{
-  ros::init(argc, argv, "thruster_controller");
-  tf::TransformListener tf_listener;
-  ThrusterController ThrusterController(argv, &tf_listener);
-  ThrusterController.loop();
-}
-
-ThrusterController::ThrusterController(char **argv, tf::TransformListener *listener_adr)
-{
-  R_bRelw.setIdentity();
-  R_wRelb.setIdentity();
-  ang_v.setZero();
-  isBuoyant = false;
-
-  listener = listener_adr;
-
-  thrust.header.frame_id = "base_link";
-
-  state_sub = nh.subscribe<riptide_msgs::Imu>("state/imu", 1, &ThrusterController::state, this);
-  depth_sub = nh.subscribe<riptide_msgs::Depth>("state/depth", 1, &ThrusterController::depth, this); //<-
-  cmd_sub = nh.subscribe<geometry_msgs::Accel>("command/accel", 1, &ThrusterController::callback, this);
-  cmd_pub = nh.advertise<riptide_msgs::ThrustStamped>("command/thrust", 1);
-
-  listener->waitForTransform("/base_link", "/surge_port_hi_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/surge_port_hi_link", ros::Time(0), tf_surge[0]);
-  listener->waitForTransform("/base_link", "/surge_stbd_hi_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/surge_stbd_hi_link", ros::Time(0), tf_surge[1]);
-  listener->waitForTransform("/base_link", "/surge_port_lo_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/surge_port_lo_link", ros::Time(0), tf_surge[2]);
-  listener->waitForTransform("/base_link", "/surge_stbd_lo_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/surge_stbd_lo_link", ros::Time(0), tf_surge[3]);
-  listener->waitForTransform("/base_link", "/sway_fwd_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/sway_fwd_link", ros::Time(0), tf_sway[0]);
-  listener->waitForTransform("/base_link", "/sway_aft_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/sway_aft_link", ros::Time(0), tf_sway[1]);
-  listener->waitForTransform("/base_link", "/heave_port_fwd_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/heave_port_fwd_link", ros::Time(0), tf_heave[0]);
-  listener->waitForTransform("/base_link", "/heave_stbd_fwd_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/heave_stbd_fwd_link", ros::Time(0), tf_heave[1]);
-  listener->waitForTransform("/base_link", "/heave_port_aft_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/heave_port_aft_link", ros::Time(0), tf_heave[2]);
-  listener->waitForTransform("/base_link", "/heave_stbd_aft_link", ros::Time(0), ros::Duration(10.0));
-  listener->lookupTransform("/base_link", "/heave_stbd_aft_link", ros::Time(0), tf_heave[3]);
-
-  get_transform(&pos_surge_port_hi, &tf_surge[0]);
-  get_transform(&pos_surge_stbd_hi, &tf_surge[1]);
-  get_transform(&pos_surge_port_lo, &tf_surge[2]);
-  get_transform(&pos_surge_stbd_lo, &tf_surge[3]);
-  get_transform(&pos_sway_fwd, &tf_sway[0]);
-  get_transform(&pos_sway_aft, &tf_sway[1]);
-  get_transform(&pos_heave_port_fwd, &tf_heave[0]);
-  get_transform(&pos_heave_stbd_fwd, &tf_heave[1]);
-  get_transform(&pos_heave_port_aft, &tf_heave[2]);
-  get_transform(&pos_heave_stbd_aft, &tf_heave[3]);
-
-  google::InitGoogleLogging(argv[0]);
-
-  // PROBLEM SETUP
-
-  // Add residual blocks (equations)
-
-  // Linear
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<surge, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1>(new surge), NULL,
-                           &surge_port_hi, &surge_stbd_hi, &surge_port_lo, &surge_stbd_lo, &sway_fwd, &sway_aft,
-                           &heave_port_fwd, &heave_stbd_fwd, &heave_port_aft, &heave_stbd_aft);
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<sway, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1>(new sway), NULL,
-                           &surge_port_hi, &surge_stbd_hi, &surge_port_lo, &surge_stbd_lo, &sway_fwd, &sway_aft,
-                           &heave_port_fwd, &heave_stbd_fwd, &heave_port_aft, &heave_stbd_aft);
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<heave, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1>(new heave), NULL,
-                           &surge_port_hi, &surge_stbd_hi, &surge_port_lo, &surge_stbd_lo, &sway_fwd, &sway_aft,
-                           &heave_port_fwd, &heave_stbd_fwd, &heave_stbd_aft, &heave_port_aft);
-
-  // Angular
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<roll, 1, 1, 1, 1, 1, 1, 1>(new roll), NULL, &sway_fwd,
-                           &sway_aft, &heave_port_fwd, &heave_stbd_fwd, &heave_port_aft, &heave_stbd_aft);
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<pitch, 1, 1, 1, 1, 1, 1, 1, 1, 1>(new pitch), NULL,
-                           &surge_port_hi, &surge_stbd_hi, &surge_port_lo, &surge_stbd_lo, &heave_port_fwd,
-                           &heave_stbd_fwd, &heave_port_aft, &heave_stbd_aft);
-  problem.AddResidualBlock(new ceres::AutoDiffCostFunction<yaw, 1, 1, 1, 1, 1, 1, 1>(new yaw), NULL, &surge_port_hi,
-                           &surge_stbd_hi, &surge_port_lo, &surge_stbd_lo, &sway_fwd, &sway_aft);
-
-  // Set constraints (min/max thruster force)
-
-  // Surge thrusters
-  problem.SetParameterLowerBound(&surge_port_hi, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&surge_port_hi, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&surge_stbd_hi, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&surge_stbd_hi, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&surge_port_lo, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&surge_port_lo, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&surge_stbd_lo, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&surge_stbd_lo, 0, MAX_THRUST);
-
-  // Sway thrusters
-  problem.SetParameterLowerBound(&sway_fwd, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&sway_fwd, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&sway_aft, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&sway_aft, 0, MAX_THRUST);
-
-  // Heave thrusters
-  problem.SetParameterLowerBound(&heave_port_fwd, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&heave_port_fwd, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&heave_stbd_fwd, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&heave_stbd_fwd, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&heave_port_aft, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&heave_port_aft, 0, MAX_THRUST);
-
-  problem.SetParameterLowerBound(&heave_stbd_aft, 0, MIN_THRUST);
-  problem.SetParameterUpperBound(&heave_stbd_aft, 0, MAX_THRUST);
-
-  // Configure solver
-  options.max_num_iterations = 100;
-  options.linear_solver_type = ceres::DENSE_QR;
-
-#ifdef progress
-  options.minimizer_progress_to_stdout = true;
-#endif
-}
-
-//Get orientation from IMU
-void ThrusterController::state(const riptide_msgs::Imu::ConstPtr &msg)
-{
-  //Get euler angles, convert to radians, and make two rotation matrices
-  tf::Vector3 tf;
-  vector3MsgToTF(msg->euler_rpy, tf);
-  tf.setValue(tf.x()*PI/180, tf.y()*PI/180, tf.y()*PI/180);
-  R_wRelb.setRPY(tf.x(), tf.y(), tf.z());
-  R_bRelw = R_bRelw.transpose();
-
-  //Get angular velocity and convert to [rad/s]
-  vector3MsgToTF(msg->ang_v, ang_v);
-  ang_v.setValue(ang_v.x()*PI/180, ang_v.y()*PI/180, ang_v.y()*PI/180);
-}
-
-//Get depth and determine if buoyancy should be included
-void ThrusterController::depth(const riptide_msgs::Depth::ConstPtr &msg)
-{
-  if(msg->depth > 0.2){
-    isBuoyant = true;
-  } else {
-    isBuoyant = false;
-  }
-}
-
-void ThrusterController::callback(const geometry_msgs::Accel::ConstPtr &a)
-{
-  cmdSurge = a->linear.x;
-  cmdSway = a->linear.y;
-  cmdHeave = a->linear.z;
-  cmdRoll = a->angular.x;
-  cmdPitch = a->angular.y;
-  cmdYaw = a->angular.z;
-
-  // These forced initial guesses don't make much of a difference.
-  // We currently experience a sort of gimbal lock w/ or w/o them.
-  surge_stbd_hi = 0.0;
-  surge_port_hi = 0.0;
-  surge_port_lo = 0.0;
-  surge_stbd_lo = 0.0;
-  sway_fwd = 0.0;
-  sway_aft = 0.0;
-  heave_port_aft = 0.0;
-  heave_stbd_aft = 0.0;
-  heave_stbd_fwd = 0.0;
-  heave_port_fwd = 0.0;
-
-#ifdef debug
-  std::cout << "Initial surge_stbd_hi = " << surge_stbd_hi << ", surge_port_hi = " << surge_port_hi
-            << ", surge_port_lo = " << surge_port_lo << ", surge_stbd_lo = " << surge_stbd_lo
-            << ", sway_fwd = " << sway_fwd << ", sway_aft = " << sway_aft << ", heave_port_aft = " << heave_port_aft
-            << ", heave_stbd_aft = " << heave_stbd_aft << ", heave_stbd_fwd = " << heave_stbd_fwd
-            << ", heave_port_fwd = " << heave_port_fwd << std::endl;
-#endif
-
-  // Solve all my problems
-  ceres::Solve(options, &problem, &summary);
-
-#ifdef report
-  std::cout << summary.FullReport() << std::endl;
-#endif
-
-#ifdef debug
-  std::cout << "Final surge_stbd_hi = " << surge_stbd_hi << ", surge_port_hi = " << surge_port_hi
-            << ", surge_port_lo = " << surge_port_lo << ", surge_stbd_lo = " << surge_stbd_lo
-            << ", sway_fwd = " << sway_fwd << ", sway_aft = " << sway_aft << ", heave_port_aft = " << heave_port_aft
-            << ", heave_stbd_aft = " << heave_stbd_aft << ", heave_stbd_fwd = " << heave_stbd_fwd
-            << ", heave_port_fwd = " << heave_port_fwd << std::endl;
-#endif
-
-  // Create stamped thrust message
-  thrust.header.stamp = ros::Time::now();
-
-  thrust.force.surge_stbd_hi = surge_stbd_hi;
-  thrust.force.surge_port_hi = surge_port_hi;
-  thrust.force.surge_port_lo = surge_port_lo;
-  thrust.force.surge_stbd_lo = surge_stbd_lo;
-  thrust.force.sway_fwd = sway_fwd;
-  thrust.force.sway_aft = sway_aft;
-  thrust.force.heave_port_aft = heave_port_aft;
-  thrust.force.heave_stbd_aft = heave_stbd_aft;
-  thrust.force.heave_stbd_fwd = heave_stbd_fwd;
-  thrust.force.heave_port_fwd = heave_port_fwd;
-
-  cmd_pub.publish(thrust);
-}
-
-void ThrusterController::loop()
-{
-  ros::spin();
-}
+#include "riptide_controllers/thruster_controller.h"
+#include <boost/make_shared.hpp>
+
+#undef debug
+
+#define PI 3.141592653
+
+// Surface buoyancy threshold (m)
+#define BUOYANCY_DEPTH 0.2
+
+// Monotonic clock in seconds, for timing the allocation loop
+double monotonicNow()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Thruster flags in Thruster order
+void maskFromMsg(const riptide_msgs::ThrusterMask &msg, bool allocated[NUM_THRUSTERS])
+{
+  allocated[SURGE_PORT_HI] = msg.surge_port_hi;
+  allocated[SURGE_STBD_HI] = msg.surge_stbd_hi;
+  allocated[SURGE_PORT_LO] = msg.surge_port_lo;
+  allocated[SURGE_STBD_LO] = msg.surge_stbd_lo;
+  allocated[SWAY_FWD] = msg.sway_fwd;
+  allocated[SWAY_AFT] = msg.sway_aft;
+  allocated[HEAVE_PORT_FWD] = msg.heave_port_fwd;
+  allocated[HEAVE_STBD_FWD] = msg.heave_stbd_fwd;
+  allocated[HEAVE_PORT_AFT] = msg.heave_port_aft;
+  allocated[HEAVE_STBD_AFT] = msg.heave_stbd_aft;
+}
+
+ThrusterController::ThrusterController(char **argv, tf::TransformListener *listener_adr, const ros::NodeHandle &node)
+    : nh(node)
+{
+  double startup = monotonicNow();
+  ros::NodeHandle tcp(nh, "thruster_controller");
+  std::string solver;
+  tcp.param<std::string>("solver", solver, "pseudo_inverse");
+  if (solver == "ceres")
+    mode = CERES;
+  else if (solver == "pseudo_inverse")
+    mode = PSEUDO_INVERSE;
+  else if (solver == "qp")
+    mode = QP;
+  else
+  {
+    ROS_WARN("Unknown solver '%s', using pseudo_inverse", solver.c_str());
+    solver = "pseudo_inverse";
+    mode = PSEUDO_INVERSE;
+  }
+
+  // Relative thruster weights for the pseudo-inverse and the QP power term (higher = used less)
+  ThrustVector weights = ThrustVector::Ones();
+  std::vector<double> weight_param;
+  if (tcp.getParam("weights", weight_param))
+  {
+    if (weight_param.size() == NUM_THRUSTERS)
+      weights = Eigen::Map<ThrustVector>(weight_param.data());
+    else
+      ROS_WARN("thruster_controller/weights needs %d entries, ignoring", NUM_THRUSTERS);
+  }
+
+  // QP objective: acceleration tracking, thrust power and thrust rate of change
+  QPOptions qp;
+  tcp.param<double>("qp_tracking_weight", qp.tracking_weight, qp.tracking_weight);
+  tcp.param<double>("qp_power_weight", qp.power_weight, qp.power_weight);
+  tcp.param<double>("qp_rate_weight", qp.rate_weight, qp.rate_weight);
+
+  // Remember solutions for recurring commands (cache_size = 0 disables)
+  CacheOptions cache_options;
+  int cache_size;
+  tcp.param<int>("cache_size", cache_size, 0);
+  cache_options.capacity = std::max(cache_size, 0);
+  tcp.param<double>("cache_accel_resolution", cache_options.accel_resolution, cache_options.accel_resolution);
+  tcp.param<double>("cache_tilt_resolution", cache_options.tilt_resolution, cache_options.tilt_resolution);
+  tcp.param<double>("cache_max_ang_v", cache_options.max_ang_v, cache_options.max_ang_v);
+  // The QP rate term makes the solution depend on the previous thrust, which
+  // the key does not capture, so a cached answer would be for another history
+  if (mode == QP && qp.rate_weight != 0 && cache_options.capacity > 0)
+  {
+    ROS_WARN("Allocation cache disabled: qp solutions depend on the previous thrust while qp_rate_weight is nonzero");
+    cache_options.capacity = 0;
+  }
+  cache = AllocationCache(cache_options);
+  cache_entries = 0;
+
+  // Reuse the previous solution between nearly identical commands
+  WarmStartOptions warm_start;
+  tcp.param<bool>("warm_start", warm_start.enabled, false);
+  tcp.param<double>("warm_start_tolerance", warm_start.tolerance, warm_start.tolerance);
+
+  // More than one thread lets IMU/depth callbacks run while a solve is in progress
+  tcp.param<int>("spinner_threads", spinner_threads, 1);
+
+  // Fixed-rate allocation, decoupled from how often command/accel arrives
+  tcp.param<double>("loop_rate", loop_rate, 0.0);
+  tcp.param<int>("loop_priority", loop_priority, 0);
+  tcp.param<double>("command_timeout", command_timeout, 0.5);
+
+  listener = listener_adr;
+  buoyant = false;
+  running = false;
+
+  thrust.header.frame_id = "base_link";
+  forces.setZero();
+
+  state_sub = nh.subscribe<riptide_msgs::Imu>("state/imu", 1, &ThrusterController::state, this);
+  depth_sub = nh.subscribe<riptide_msgs::DepthState>("state/depth", 1, &ThrusterController::depth, this); //<-
+  cmd_sub = nh.subscribe<geometry_msgs::Accel>("command/accel", 1, &ThrusterController::callback, this);
+  mask_sub = nh.subscribe<riptide_msgs::ThrusterMask>("command/thruster_mask", 1, &ThrusterController::maskCallback, this);
+  mask_srv = nh.advertiseService("set_thruster_mask", &ThrusterController::setMask, this);
+  cmd_pub = nh.advertise<riptide_msgs::ThrustStamped>("command/thrust", 1);
+  diag_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+  diag_timer = nh.createWallTimer(ros::WallDuration(1.0), &ThrusterController::publishDiagnostics, this);
+
+  // Thruster positions: "auto" tries the URDF, then the cached geometry, then TF;
+  // "tf" always waits for the transforms; "generated" uses the layout compiled in
+  // from thruster_layout.h
+  std::string geometry_source, source;
+  double tf_timeout;
+  tcp.param<std::string>("geometry_source", geometry_source, "auto");
+  tcp.param<double>("tf_timeout", tf_timeout, 10.0);
+  if (geometry_source == "generated")
+  {
+    geometry = layoutGeometry();
+    source = "generated layout";
+  }
+  else if (geometry_source != "tf" && loadGeometryFromURDF())
+    source = "robot_description";
+  else if (geometry_source != "tf" && loadGeometryFromParams(tcp))
+    source = "cached geometry";
+  else if (loadGeometryFromTF(tf_timeout))
+    source = "tf";
+  else
+  {
+    ROS_ERROR("No thruster geometry after %.1f s, thrusters will only produce force", tf_timeout);
+    source = "none";
+  }
+
+  // Thrusters left out of allocation at startup (the surge_*_hi thrusters are not used yet).
+  // command/thruster_mask or set_thruster_mask change this at runtime.
+  std::vector<std::string> disabled;
+  std::vector<std::string> default_disabled;
+  default_disabled.push_back("surge_port_hi");
+  default_disabled.push_back("surge_stbd_hi");
+  tcp.param<std::vector<std::string> >("disabled_thrusters", disabled, default_disabled);
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+    geometry.allocated[i] = std::find(disabled.begin(), disabled.end(), THRUSTER_NAMES[i]) == disabled.end();
+
+  // The compiled-in layout goes stale when riptide_description changes
+  double layout_error = (buildAllocationMatrix(vehicle, geometry) -
+                         layoutAllocationMatrix(vehicle, geometry.allocated)).cwiseAbs().maxCoeff();
+  if (layout_error > 1e-3)
+    ROS_WARN("Thruster geometry from %s differs from thruster_layout.h, rerun scripts/generate_thruster_geometry.py",
+             source.c_str());
+
+  AllocationMask initial;
+  std::copy(geometry.allocated, geometry.allocated + NUM_THRUSTERS, initial.allocated);
+  mask.store(initial);
+  mask_version = mask.version();
+
+  // Once per process, since a nodelet manager can load the controller again
+  static bool glog_initialized = false;
+  if (!glog_initialized)
+  {
+    google::InitGoogleLogging(argv[0]);
+    glog_initialized = true;
+  }
+
+  ceres_allocator = new CeresAllocator(vehicle, geometry, warm_start);
+  pinv_allocator = new PseudoInverseAllocator(vehicle, geometry, weights, warm_start);
+  qp_allocator = new QPAllocator(vehicle, geometry, weights, qp, warm_start);
+  ROS_INFO("Thruster controller using %s allocation", solver.c_str());
+  ROS_INFO("Thruster controller ready in %.1f ms (geometry from %s)", 1e3 * (monotonicNow() - startup),
+           source.c_str());
+}
+
+// Thruster positions from the robot_description URDF, by composing the joint
+// origins from each thruster link up to base_link
+bool ThrusterController::loadGeometryFromURDF()
+{
+  urdf::Model model;
+  std::string xml;
+  if (!nh.getParam("robot_description", xml) || !model.initString(xml))
+    return false;
+
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    auto link = model.getLink(std::string(THRUSTER_NAMES[i]) + "_link");
+    if (!link)
+    {
+      ROS_WARN("robot_description has no %s_link", THRUSTER_NAMES[i]);
+      return false;
+    }
+
+    Eigen::Vector3d p = Eigen::Vector3d::Zero();
+    while (link->name != "base_link")
+    {
+      auto joint = link->parent_joint;
+      if (!joint)
+      {
+        ROS_WARN("%s_link is not attached to base_link", THRUSTER_NAMES[i]);
+        return false;
+      }
+      const urdf::Pose &origin = joint->parent_to_joint_origin_transform;
+      double qx, qy, qz, qw;
+      origin.rotation.getQuaternion(qx, qy, qz, qw);
+      p = Eigen::Quaterniond(qw, qx, qy, qz) * p +
+          Eigen::Vector3d(origin.position.x, origin.position.y, origin.position.z);
+      link = model.getLink(joint->parent_link_name);
+    }
+    geometry.position[i] = p;
+  }
+  return true;
+}
+
+// Thruster positions cached by scripts/generate_thruster_geometry.py
+// (thruster_controller/geometry/<thruster>: [x, y, z])
+bool ThrusterController::loadGeometryFromParams(const ros::NodeHandle &tcp)
+{
+  Eigen::Vector3d positions[NUM_THRUSTERS];
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    std::vector<double> p;
+    if (!tcp.getParam(std::string("geometry/") + THRUSTER_NAMES[i], p) || p.size() != 3)
+      return false;
+    positions[i] << p[0], p[1], p[2];
+  }
+  std::copy(positions, positions + NUM_THRUSTERS, geometry.position);
+  return true;
+}
+
+// One shared deadline for all thruster transforms instead of one timeout each
+bool ThrusterController::loadGeometryFromTF(double timeout)
+{
+  ros::Time deadline = ros::Time::now() + ros::Duration(timeout);
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    std::string frame = std::string("/") + THRUSTER_NAMES[i] + "_link";
+    ros::Duration remaining = std::max(deadline - ros::Time::now(), ros::Duration(0.0));
+    tf::StampedTransform tform;
+    try
+    {
+      if (!listener->waitForTransform("/base_link", frame, ros::Time(0), remaining))
+        return false;
+      listener->lookupTransform("/base_link", frame, ros::Time(0), tform);
+    }
+    catch (tf::TransformException &ex)
+    {
+      ROS_WARN("%s", ex.what());
+      return false;
+    }
+    geometry.position[i] << tform.getOrigin().x(), tform.getOrigin().y(), tform.getOrigin().z();
+  }
+  return true;
+}
+
+ThrusterController::~ThrusterController()
+{
+  delete ceres_allocator;
+  delete pinv_allocator;
+  delete qp_allocator;
+}
+
+//Get orientation from IMU
+void ThrusterController::state(const riptide_msgs::Imu::ConstPtr &msg)
+{
+  //Get euler angles, convert to radians, and make the rotation matrix
+  VehicleState snapshot;
+  tf::Vector3 tf;
+  tf::Matrix3x3 R_wRelb;
+  vector3MsgToTF(msg->euler_rpy, tf);
+  tf.setValue(tf.x()*PI/180, tf.y()*PI/180, tf.y()*PI/180);
+  R_wRelb.setRPY(tf.x(), tf.y(), tf.z());
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      snapshot.R_wRelb(i, j) = R_wRelb[i][j];
+
+  //Get angular velocity and convert to [rad/s]
+  tf::Vector3 ang_v;
+  vector3MsgToTF(msg->ang_v, ang_v);
+  snapshot.ang_v << ang_v.x()*PI/180, ang_v.y()*PI/180, ang_v.y()*PI/180;
+
+  attitude.store(snapshot);
+}
+
+//Get depth and determine if buoyancy should be included
+void ThrusterController::depth(const riptide_msgs::DepthState::ConstPtr &msg)
+{
+  if(msg->depth > BUOYANCY_DEPTH){
+    buoyant = true;
+  } else {
+    buoyant = false;
+  }
+
+  // depth_processor keeps the sensor's stamp, so this is the latency from the sample
+  if (msg->header.stamp.isZero())
+    return;
+  double age = (ros::Time::now() - msg->header.stamp).toSec();
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  stats.depth_samples++;
+  stats.depth_age_sum += age;
+  stats.depth_age_max = std::max(stats.depth_age_max, age);
+}
+
+void ThrusterController::callback(const geometry_msgs::Accel::ConstPtr &a)
+{
+  TimedCommand latest;
+  latest.accel << a->linear.x, a->linear.y, a->linear.z, a->angular.x, a->angular.y, a->angular.z;
+  latest.stamp = monotonicNow();
+
+  // In fixed-rate mode the allocation loop picks this up on its next cycle
+  if (loop_rate > 0)
+    command.store(latest);
+  else
+    allocate(latest.accel);
+}
+
+void ThrusterController::maskCallback(const riptide_msgs::ThrusterMask::ConstPtr &msg)
+{
+  std::string warning = updateMask(*msg);
+  if (!warning.empty())
+    ROS_WARN("%s", warning.c_str());
+}
+
+bool ThrusterController::setMask(riptide_msgs::SetThrusterMask::Request &req,
+                                 riptide_msgs::SetThrusterMask::Response &res)
+{
+  res.message = updateMask(req.mask);
+  res.success = true;
+  return true;
+}
+
+// Hands a new mask to the allocation thread, and returns a warning if the
+// remaining thrusters cannot control every axis
+std::string ThrusterController::updateMask(const riptide_msgs::ThrusterMask &msg)
+{
+  AllocationMask next;
+  maskFromMsg(msg, next.allocated);
+
+  {
+    std::lock_guard<std::mutex> lock(mask_mutex);
+    mask.store(next);
+  }
+
+  ThrusterGeometry remaining = geometry;
+  std::copy(next.allocated, next.allocated + NUM_THRUSTERS, remaining.allocated);
+  Eigen::FullPivLU<AllocationMatrix> lu(buildAllocationMatrix(vehicle, remaining));
+  if (lu.rank() < 6)
+    return "Thruster mask leaves " + std::to_string(6 - lu.rank()) + " axes uncontrollable";
+  return "";
+}
+
+// Rebuilds the allocators for the latest mask. Called from allocate() so a
+// solve never runs against a half-updated allocator.
+void ThrusterController::applyMask()
+{
+  double start = monotonicNow();
+  mask_version = mask.version();
+  AllocationMask latest = mask.load();
+  ceres_allocator->setAllocated(latest.allocated);
+  pinv_allocator->setAllocated(latest.allocated);
+  qp_allocator->setAllocated(latest.allocated);
+  cache.clear();
+  cache_entries = 0;
+
+  std::string active;
+  for (int i = 0; i < NUM_THRUSTERS; i++)
+  {
+    if (latest.allocated[i])
+      active += std::string(active.empty() ? "" : ", ") + THRUSTER_NAMES[i];
+  }
+  ROS_INFO("Allocating to [%s] (rebuilt in %.1f us)", active.c_str(), 1e6 * (monotonicNow() - start));
+}
+
+void ThrusterController::allocate(const Vector6d &cmd)
+{
+  if (mask.version() != mask_version)
+    applyMask();
+
+  double start = monotonicNow();
+
+  // Consistent copy of the latest state, however often it is being updated
+  VehicleState vehicle_state = attitude.load();
+  vehicle_state.buoyant = buoyant;
+
+  // Recurring commands come straight from the cache
+  AllocationKey key;
+  bool cacheable = cache.enabled() && cache.makeKey(cmd, vehicle_state, key);
+  bool hit = cacheable && cache.lookup(key, forces);
+
+  // Solve all my problems
+  AllocationStats result;
+  if (!hit)
+  {
+    if (mode == CERES)
+      result = ceres_allocator->allocate(cmd, vehicle_state, forces);
+    else if (mode == QP)
+      result = qp_allocator->allocate(cmd, vehicle_state, forces);
+    else
+      result = pinv_allocator->allocate(cmd, vehicle_state, forces);
+
+    if (cacheable)
+    {
+      cache.insert(key, forces);
+      cache_entries = cache.size();
+    }
+  }
+
+  double solve_time = monotonicNow() - start;
+
+#ifdef debug
+  std::cout << "Thrust = " << forces.transpose() << ", iterations = " << result.iterations
+            << ", saturated = " << result.saturated << ", residual = " << result.residual << std::endl;
+#endif
+
+  // Create stamped thrust message
+  thrust.header.stamp = ros::Time::now();
+
+  thrust.force.surge_stbd_hi = forces(SURGE_STBD_HI);
+  thrust.force.surge_port_hi = forces(SURGE_PORT_HI);
+  thrust.force.surge_port_lo = forces(SURGE_PORT_LO);
+  thrust.force.surge_stbd_lo = forces(SURGE_STBD_LO);
+  thrust.force.sway_fwd = forces(SWAY_FWD);
+  thrust.force.sway_aft = forces(SWAY_AFT);
+  thrust.force.heave_port_aft = forces(HEAVE_PORT_AFT);
+  thrust.force.heave_stbd_aft = forces(HEAVE_STBD_AFT);
+  thrust.force.heave_stbd_fwd = forces(HEAVE_STBD_FWD);
+  thrust.force.heave_port_fwd = forces(HEAVE_PORT_FWD);
+
+  cmd_pub.publish(boost::make_shared<riptide_msgs::ThrustStamped>(thrust));
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  if (!cache.enabled())
+    ;
+  else if (hit)
+    stats.cache_hits++;
+  else if (cacheable)
+    stats.cache_misses++;
+  else
+    stats.cache_bypassed++;
+  stats.solves++;
+  stats.solve_sum += solve_time;
+  stats.solve_max = std::max(stats.solve_max, solve_time);
+}
+
+// Runs allocation at loop_rate on its own thread, always with the freshest
+// command and state
+void ThrusterController::allocationLoop()
+{
+  if (loop_priority > 0)
+  {
+    sched_param param;
+    param.sched_priority = loop_priority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+      ROS_WARN("Could not set SCHED_FIFO priority %d (needs CAP_SYS_NICE), using normal scheduling", loop_priority);
+  }
+
+  const long period_ns = static_cast<long>(1e9 / loop_rate);
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  while (running)
+  {
+    deadline.tv_nsec += period_ns;
+    while (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_nsec -= 1000000000;
+      deadline.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+
+    double release = deadline.tv_sec + deadline.tv_nsec * 1e-9;
+    double wake = monotonicNow();
+
+    // Only keep thrusting while the control stack is still talking to us
+    TimedCommand latest = command.load();
+    if (latest.stamp > 0 && wake - latest.stamp < command_timeout)
+      allocate(latest.accel);
+
+    // Finished after the next cycle should have started
+    double end = monotonicNow();
+    bool missed = end > release + period_ns * 1e-9;
+    if (missed)
+    {
+      // Resynchronize instead of running a burst of late cycles
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.cycles++;
+    stats.jitter_sum += wake - release;
+    stats.jitter_max = std::max(stats.jitter_max, wake - release);
+    if (missed)
+      stats.deadline_misses++;
+  }
+}
+
+// Diagnostic status with its values formatted as key/value pairs
+diagnostic_msgs::DiagnosticStatus makeStatus(const std::string &name, int level, const std::string &message,
+                                             const std::vector<std::pair<std::string, double> > &values)
+{
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = name;
+  status.hardware_id = "thruster_controller";
+  status.level = level;
+  status.message = message;
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = values[i].first;
+    kv.value = std::to_string(values[i].second);
+    status.values.push_back(kv);
+  }
+  return status;
+}
+
+void ThrusterController::publishDiagnostics(const ros::WallTimerEvent &event)
+{
+  LoopStats window;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    window = stats;
+    stats.reset();
+  }
+
+  diagnostic_msgs::DiagnosticArray diag;
+  diag.header.stamp = ros::Time::now();
+
+  std::vector<std::pair<std::string, double> > values;
+  values.push_back(std::make_pair("loop rate [Hz]", loop_rate));
+  values.push_back(std::make_pair("cycles", window.cycles));
+  values.push_back(std::make_pair("deadline misses", window.deadline_misses));
+  values.push_back(std::make_pair("jitter mean [us]", window.cycles ? 1e6 * window.jitter_sum / window.cycles : 0.0));
+  values.push_back(std::make_pair("jitter max [us]", 1e6 * window.jitter_max));
+  values.push_back(std::make_pair("solves", window.solves));
+  values.push_back(std::make_pair("solve mean [us]", window.solves ? 1e6 * window.solve_sum / window.solves : 0.0));
+  values.push_back(std::make_pair("solve max [us]", 1e6 * window.solve_max));
+  diag.status.push_back(makeStatus("thruster_controller: allocation",
+                                   window.deadline_misses > 0 ? diagnostic_msgs::DiagnosticStatus::WARN :
+                                                                diagnostic_msgs::DiagnosticStatus::OK,
+                                   loop_rate > 0 ? "fixed rate" : "event driven", values));
+
+  if (cache.enabled())
+  {
+    long lookups = window.cache_hits + window.cache_misses;
+    values.clear();
+    values.push_back(std::make_pair("hits", window.cache_hits));
+    values.push_back(std::make_pair("misses", window.cache_misses));
+    values.push_back(std::make_pair("bypassed (turning)", window.cache_bypassed));
+    values.push_back(std::make_pair("hit rate [%]", lookups ? 100.0 * window.cache_hits / lookups : 0.0));
+    values.push_back(std::make_pair("entries", cache_entries.load()));
+    diag.status.push_back(makeStatus("thruster_controller: allocation cache", diagnostic_msgs::DiagnosticStatus::OK,
+                                     "enabled", values));
+  }
+
+  values.clear();
+  values.push_back(std::make_pair("samples", window.depth_samples));
+  values.push_back(std::make_pair("latency mean [us]",
+                                  window.depth_samples ? 1e6 * window.depth_age_sum / window.depth_samples : 0.0));
+  values.push_back(std::make_pair("latency max [us]", 1e6 * window.depth_age_max));
+  diag.status.push_back(makeStatus("thruster_controller: depth input", diagnostic_msgs::DiagnosticStatus::OK,
+                                   window.depth_samples ? "receiving" : "no stamped depth", values));
+
+  diag_pub.publish(diag);
+}
+
+// Starts the fixed-rate allocation thread, if there is one. The nodelet calls
+// this and stop() instead of loop(), since the manager spins for it.
+void ThrusterController::start()
+{
+  if (loop_rate > 0)
+  {
+    running = true;
+    allocation_thread = std::thread(&ThrusterController::allocationLoop, this);
+  }
+}
+
+void ThrusterController::stop()
+{
+  running = false;
+  if (allocation_thread.joinable())
+    allocation_thread.join();
+}
+
+void ThrusterController::loop()
+{
+  start();
+
+  if (spinner_threads > 1)
+  {
+    ros::AsyncSpinner spinner(spinner_threads);
+    spinner.start();
+    ros::waitForShutdown();
+  }
+  else
+  {
+    ros::spin();
+  }
+
+  stop();
+}
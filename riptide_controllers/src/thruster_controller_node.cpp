@@ -0,0 +1,9 @@
+#include "riptide_controllers/thruster_controller.h"
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "thruster_controller");
+  tf::TransformListener tf_listener;
+  ThrusterController ThrusterController(argv, &tf_listener);
+  ThrusterController.loop();
+}
@@ -0,0 +1,33 @@
+// thruster_controller as a nodelet. Its callbacks are already safe to run
+// concurrently (spinner_threads), so it takes the manager's multi-threaded
+// queue; the manager's num_worker_threads replaces spinner_threads.
+
+#include "riptide_controllers/thruster_controller.h"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+class ThrusterControllerNodelet : public nodelet::Nodelet
+{
+private:
+  boost::shared_ptr<tf::TransformListener> listener;
+  boost::shared_ptr<ThrusterController> controller;
+
+  void onInit()
+  {
+    // glog keeps the program name pointer, so it has to outlive the nodelet
+    static char name[] = "thruster_controller";
+    static char *argv[] = { name, NULL };
+    listener.reset(new tf::TransformListener(getMTNodeHandle()));
+    controller.reset(new ThrusterController(argv, listener.get(), getMTNodeHandle()));
+    controller->start();
+  }
+
+public:
+  ~ThrusterControllerNodelet()
+  {
+    if (controller)
+      controller->stop();
+  }
+};
+
+PLUGINLIB_EXPORT_CLASS(ThrusterControllerNodelet, nodelet::Nodelet)
@@ -12,7 +12,7 @@
 #include "gazebo/common/Events.hh"
 
 #include "ros/ros.h"
-#include "riptide_msgs/Depth.h"
+#include "riptide_msgs/DepthState.h"
 
 namespace gazebo
 {
@@ -38,7 +38,7 @@ class DepthSensor : public ModelPlugin
   // Msg
   std::string robot_namespace_;
   std::string topic_name_;
-  riptide_msgs::Depth depth_;
+  riptide_msgs::DepthState depth_;
   // ROS
   ros::NodeHandle* rosnode_;
   ros::Publisher depth_pub_;
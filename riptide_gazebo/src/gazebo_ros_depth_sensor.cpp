@@ -13,7 +13,7 @@ DepthSensor::DepthSensor()
   this->depth_.depth = 0;
   this->depth_.pressure = 0;
   this->depth_.temp = 0;
-  this->depth_.altitude = 0;
+  this->depth_.velocity = 0;
 }
 
 DepthSensor::~DepthSensor()
@@ -39,7 +39,7 @@ void DepthSensor::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
 
   this->topic_name_ = _sdf->GetElement("topicName")->Get<std::string>();
   this->rosnode_ = new ros::NodeHandle(this->robot_namespace_);
-  this->depth_pub_ = this->rosnode_->advertise<riptide_msgs::Depth>(this->topic_name_, 1);
+  this->depth_pub_ = this->rosnode_->advertise<riptide_msgs::DepthState>(this->topic_name_, 1);
 
   this->sea_level_ = _sdf->GetElement("seaLevel")->Get<double>();
   this->fluid_density_ = _sdf->GetElement("fluidDensity")->Get<double>();
@@ -51,6 +51,7 @@ void DepthSensor::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
   {
     double z_pos = this->sensor_link_->GetWorldPose().pos.z;
     this->depth_.depth = this->sea_level_ - z_pos;
+    this->depth_.velocity = -this->sensor_link_->GetWorldLinearVel().z;
     this->depth_.pressure = this->fluid_density_ * this->gravity_ * this->depth_.depth;
     this->depth_pub_.publish(this->depth_);
   }
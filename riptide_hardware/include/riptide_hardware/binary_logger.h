@@ -0,0 +1,86 @@
+#ifndef BINARY_LOGGER_H
+#define BINARY_LOGGER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "riptide_hardware/spsc_queue.h"
+
+// Start of every log file. The file is preallocated, so records tells where the
+// data ends; it is written when the file is closed. A file whose logger died
+// has records = 0, and its data ends at the first all-zero record.
+// scripts/log_to_csv.py converts logs to CSV.
+struct LogFileHeader
+{
+  char magic[8];        // "RIPTLOG"
+  uint32_t version;     // LOG_VERSION
+  uint32_t record_type; // LOG_RECORD_* of every record in the file
+  uint32_t record_size; // Bytes
+  uint32_t reserved;
+  uint64_t records;
+};
+
+#define LOG_VERSION 1
+
+// Record types, matching RECORD_TYPES in scripts/log_to_csv.py
+#define LOG_RECORD_MAG 1
+
+// Magnetometer sample, logged by imu_logger
+struct MagRecord
+{
+  uint64_t stamp; // ns
+  float x, y, z;
+  uint32_t reserved;
+};
+
+// Appends fixed-size binary records to preallocated files from a background
+// thread. log() only copies the record into a lock-free queue, and signals the
+// eventfd the writer sleeps on only when it is asleep, so the calling callback
+// makes no system call per record and the writer does not wake without work.
+// Files are named <prefix>_<n>.bin, starting from the first unused n, and
+// rotate to the next n when full. After a failed open or write, records are
+// dropped for a back-off of up to a minute.
+class BinaryLogger
+{
+private:
+  SpscQueue queue;
+  std::string prefix;
+  uint32_t record_type;
+  size_t file_bytes; // Size each file is preallocated to
+  int file_number;
+
+  int fd;
+  int wake_fd; // eventfd, signalled by log() when the writer sleeps, and by the destructor
+  uint64_t file_records;
+  int retry_s; // Current back-off, 0 while writes succeed
+  std::chrono::steady_clock::time_point retry_at;
+  std::atomic<unsigned long> dropped_records; // Queue full or not written
+  std::atomic<unsigned long> written_records;
+  std::atomic<bool> stopping;
+  std::atomic<bool> sleeping; // Writer is about to block, or blocked, on wake_fd
+  std::thread writer;
+
+  bool openFile();
+  void closeFile();
+  void fail();
+  void writeRecords(const unsigned char *records, size_t n);
+  void wake();
+  void writerLoop();
+
+public:
+  BinaryLogger(const std::string &prefix, uint32_t record_type, size_t record_size, size_t queue_records,
+               size_t file_bytes);
+  // Writes everything still queued before returning
+  ~BinaryLogger();
+
+  // Queues a record of record_size bytes. Never blocks; false if it was dropped.
+  bool log(const void *record);
+
+  unsigned long dropped() const { return dropped_records.load(); }
+  unsigned long written() const { return written_records.load(); }
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef COPRO_PROTOCOL_H
+#define COPRO_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary protocol between the host and the coprocessor. Every frame is
+//
+//   0xA5 0x5A | type | seq | payload | CRC16
+//
+// The payload size is fixed by the type. Multi-byte fields are little-endian and
+// the CRC (CCITT, polynomial 0x1021, initial 0xFFFF) covers type, seq and payload.
+// Each side numbers its frames with its own wrapping seq, so the receiver can
+// count frames lost on the line.
+
+#define COPRO_SYNC0 0xA5
+#define COPRO_SYNC1 0x5A
+#define COPRO_HEADER_SIZE 4 // Sync, type and seq
+#define COPRO_CRC_SIZE 2
+
+// Host to coprocessor: ten PWM pulse widths (us) in riptide_msgs/Pwm field order
+#define COPRO_PWM 0x01
+#define COPRO_PWM_CHANNELS 10
+#define COPRO_PWM_PAYLOAD (2 * COPRO_PWM_CHANNELS)
+
+// Coprocessor to host: switch states and the depth samples taken since the last
+// frame, oldest first, period_us apart
+#define COPRO_TELEMETRY 0x81
+#define COPRO_DEPTH_BATCH 4
+#define COPRO_TELEMETRY_PAYLOAD (4 + 12 * COPRO_DEPTH_BATCH)
+
+#define COPRO_MAX_PAYLOAD COPRO_TELEMETRY_PAYLOAD
+#define COPRO_MAX_FRAME (COPRO_HEADER_SIZE + COPRO_MAX_PAYLOAD + COPRO_CRC_SIZE)
+
+// Bits of CoproTelemetry::switches
+#define COPRO_KILL 0x01 // sw1-sw5 follow in bits 1-5
+
+struct CoproDepthSample
+{
+  float depth;    // m
+  float pressure; // mbar
+  float temp;     // C
+};
+
+struct CoproTelemetry
+{
+  uint8_t switches;   // COPRO_KILL, then sw1-sw5
+  uint8_t count;      // Valid entries of depth
+  uint16_t period_us; // Between depth samples
+  CoproDepthSample depth[COPRO_DEPTH_BATCH];
+};
+
+uint16_t coproCrc16(const uint8_t *data, size_t len);
+
+// Payload size for a frame type, 0 for unknown types
+size_t coproPayloadSize(uint8_t type);
+
+// Write a complete frame and return its length
+size_t encodePwmFrame(uint8_t seq, const uint16_t pwm[COPRO_PWM_CHANNELS], uint8_t *frame);
+size_t encodeTelemetryFrame(uint8_t seq, const CoproTelemetry &telemetry, uint8_t *frame);
+
+void decodePwm(const uint8_t *payload, uint16_t pwm[COPRO_PWM_CHANNELS]);
+void decodeTelemetry(const uint8_t *payload, CoproTelemetry &telemetry);
+
+// Reassembles frames from a byte stream, resynchronizing on the sync bytes
+// after noise or a failed CRC
+class CoproParser
+{
+ private:
+  uint8_t buffer[COPRO_MAX_FRAME];
+  size_t length;   // Bytes of the current frame received so far
+  size_t expected; // Frame length, once the type is known
+  bool have_seq;
+  uint8_t last_seq;
+
+ public:
+  unsigned long frames;     // Valid frames
+  unsigned long crc_errors; // Frames dropped for a bad CRC
+  unsigned long lost;       // Frames missing from the seq numbering
+
+  CoproParser();
+
+  // Feed one received byte. Returns true when it completes a valid frame,
+  // which stays available through type(), seq() and payload() until the next call.
+  bool push(uint8_t byte);
+
+  uint8_t type() const { return buffer[2]; }
+  uint8_t seq() const { return buffer[3]; }
+  const uint8_t *payload() const { return buffer + COPRO_HEADER_SIZE; }
+};
+
+#endif
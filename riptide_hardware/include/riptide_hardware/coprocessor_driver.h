@@ -0,0 +1,61 @@
+#ifndef COPROCESSOR_DRIVER_H
+#define COPROCESSOR_DRIVER_H
+
+#include "ros/ros.h"
+#include "ros/callback_queue.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "riptide_msgs/Depth.h"
+#include "riptide_msgs/PwmStamped.h"
+#include "riptide_msgs/SwitchState.h"
+#include "riptide_hardware/copro_protocol.h"
+#include "riptide_hardware/message_pool.h"
+
+// Host side of the binary coprocessor protocol: sends command/pwm as PWM frames
+// and publishes the depth and switch telemetry it receives. Depth is published
+// raw on arduino/depth, for depth_processor to filter onto state/depth.
+//
+// Everything runs on the thread in Loop(): command/pwm is on the driver's own
+// callback queue, which Loop() services between reads, so the port needs no
+// lock. Depth goes out by pointer from a pool, so depth_processor reaches it
+// without a copy when both are nodelets in one manager.
+class CoprocessorDriver
+{
+private:
+  ros::CallbackQueue queue; // Before nh and pwm_sub, which use it
+  ros::NodeHandle nh;
+  ros::Subscriber pwm_sub;
+  ros::Publisher depth_pub;
+  ros::Publisher switch_pub;
+  MessagePool<riptide_msgs::Depth> depth_pool;
+
+  std::string port;
+  int baud;
+  int fd; // Serial port, -1 while disconnected
+  ros::WallTime next_reopen;
+  uint8_t tx_seq;
+  CoproParser parser;
+  unsigned long reported_errors; // crc_errors + lost at the last warning
+
+  std::atomic<bool> running;
+  std::thread loop_thread;
+
+  bool openPort();
+  void closePort(const char *reason);
+  void handleTelemetry(const CoproTelemetry &telemetry, const ros::Time &received);
+
+public:
+  CoprocessorDriver();
+  CoprocessorDriver(const ros::NodeHandle &node);
+  ~CoprocessorDriver();
+  void PwmCB(const riptide_msgs::PwmStamped::ConstPtr &msg);
+  // Runs until shutdown or stop()
+  void Loop();
+  // Loop() on a thread of its own, for the nodelet
+  void start();
+  void stop();
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef DEPTH_ESTIMATOR_H
+#define DEPTH_ESTIMATOR_H
+
+#define DEPTH_MEDIAN_MAX_WINDOW 9
+
+// Median-of-N spike rejector. A sample further than the threshold from the
+// median of the last N samples (itself included) is replaced by that median.
+// Other samples pass through unchanged, so good data is not delayed.
+class DepthSpikeFilter
+{
+private:
+  int window, count, pos;
+  double threshold;
+  double samples[DEPTH_MEDIAN_MAX_WINDOW]; // Circular, raw samples
+
+public:
+  DepthSpikeFilter();
+
+  // The window is made odd and clamped to 1..DEPTH_MEDIAN_MAX_WINDOW; 1 turns
+  // rejection off
+  void configure(int median_window, double spike_threshold);
+
+  // Returns the sample to use, and sets rejected if it was a spike. Nothing is
+  // rejected until the window has filled.
+  double apply(double x, bool &rejected);
+  void reset() { count = 0; pos = 0; }
+  bool isFull() const { return count == window; }
+  int getWindow() const { return window; }
+};
+
+// Kalman filter for depth and vertical velocity, both positive down. Without
+// the IMU the vehicle is modelled as moving at constant velocity, disturbed by
+// white acceleration noise. With it, the IMU's vertical acceleration drives the
+// prediction and a third state tracks its bias, which also soaks up residual
+// gravity from tilt and calibration error. Every step is a fixed 3x3 update.
+class DepthEstimator
+{
+private:
+  bool initialized;
+  double x[3];    // Depth [m], velocity [m/s], accelerometer bias [m/s^2]
+  double P[3][3]; // Covariance of x
+
+  double depth_var;   // Measurement noise [m^2]
+  double model_var;   // Unmodelled acceleration without the IMU [m^2/s^4]
+  double accel_var;   // IMU acceleration noise [m^2/s^4]
+  double bias_var;    // IMU bias random walk [m^2/s^5]
+  double bias_var0;   // Initial bias uncertainty [m^2/s^4]
+
+  void propagate(double dt, double q, double bias_q, double k);
+
+public:
+  DepthEstimator();
+
+  // Standard deviations: depth measurement [m], model acceleration without the
+  // IMU [m/s^2], IMU acceleration [m/s^2], IMU bias walk [m/s^2/sqrt(s)] and
+  // initial IMU bias [m/s^2]
+  void configure(double depth_sigma, double model_accel_sigma, double imu_accel_sigma, double imu_bias_sigma,
+                 double imu_bias_initial);
+
+  // Advances dt seconds on the constant-velocity model; the bias is held
+  void predict(double dt);
+  // Advances dt seconds with accel, the measured vertical acceleration
+  // (positive down) held over the interval
+  void predict(double dt, double accel);
+  // Corrects with a depth measurement; the first one after a reset sets the
+  // depth and starts the vehicle at rest
+  void update(double depth);
+
+  void reset() { initialized = false; }
+  bool isInitialized() const { return initialized; }
+  double getDepth() const { return x[0]; }
+  double getVelocity() const { return x[1]; }
+  double getBias() const { return x[2]; }
+};
+
+#endif
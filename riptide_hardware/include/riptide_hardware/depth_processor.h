@@ -2,10 +2,16 @@
 #define DEPTH_PROCESSOR_H
 #define DEPTH_OFFSET 0.1
 #define DEPTH_SLOPE 1
+#define DEPTH_MAX_GAP 1.0 //Seconds without depth after which the estimator restarts
+#define IMU_MAX_AGE 0.5 //Seconds after which the last IMU acceleration is not used
 
 
 #include "ros/ros.h"
 #include "riptide_msgs/Depth.h"
+#include "riptide_msgs/DepthState.h"
+#include "riptide_msgs/Imu.h"
+#include "riptide_hardware/depth_estimator.h"
+#include "riptide_hardware/message_pool.h"
 
 
 class DepthProcessor
@@ -13,12 +19,24 @@ class DepthProcessor
 
 private:
   ros::NodeHandle nh;
-  ros::Subscriber depth_sub;
+  ros::Subscriber depth_sub, imu_sub;
   ros::Publisher state_depth_pub;
-  riptide_msgs::Depth lastDepth;
+  MessagePool<riptide_msgs::DepthState> pool;
+
+  DepthSpikeFilter spike_filter;
+  DepthEstimator estimator;
+  ros::Time last_stamp;
+  unsigned long spikes;
+
+  bool use_imu;
+  double imu_gravity; //Vertical reading of the IMU at rest [m/s^2]
+  double imu_accel; //Latest vertical acceleration, positive down [m/s^2]
+  ros::Time imu_stamp;
 public:
   DepthProcessor();
+  DepthProcessor(const ros::NodeHandle &node);
   void DepthCB(const riptide_msgs::Depth::ConstPtr& msg);
+  void ImuCB(const riptide_msgs::Imu::ConstPtr& imu);
 };
 
 #endif
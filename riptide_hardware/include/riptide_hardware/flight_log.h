@@ -0,0 +1,163 @@
+#ifndef FLIGHT_LOG_H
+#define FLIGHT_LOG_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Flight recorder log: a FlightLogHeader, then fixed-size chunks, each a
+// ChunkHeader followed by 8-byte aligned records
+//
+//   RecordHeader | payload (length bytes) | padding
+//
+// Message payloads are ROS-serialized messages. A topic's RECORD_TOPIC record,
+// giving its name and type, comes before its first message in every file.
+// Chunks are in time order and each header holds its time range, so a reader
+// finds a time by bisecting the chunk headers. A chunk is valid as soon as its
+// header is written; a file cut short by a crash ends at the first chunk with
+// no magic.
+
+#define FLIGHT_LOG_VERSION 1
+#define CHUNK_MAGIC 0x4B4E4843 // "CHNK"
+
+struct FlightLogHeader
+{
+  char magic[8];       // "RIPTREC"
+  uint32_t version;    // FLIGHT_LOG_VERSION
+  uint32_t chunk_size; // Bytes, headers included
+  uint64_t created;    // ns
+  uint64_t reserved;
+};
+
+struct ChunkHeader
+{
+  uint32_t magic;    // CHUNK_MAGIC
+  uint32_t used;     // Bytes of records after this header
+  uint32_t records;
+  uint32_t sequence; // Counts chunks from the recorder's start, across files
+  uint64_t start;    // ns, stamp of the first record
+  uint64_t end;      // ns, stamp of the last record
+};
+
+enum RecordKind
+{
+  RECORD_MESSAGE = 0,
+  RECORD_TOPIC = 1 // Payload: name, datatype, md5sum and definition, each nul-terminated
+};
+
+struct RecordHeader
+{
+  uint64_t stamp;  // ns, receive time
+  uint16_t topic;  // Index into the recorder's topic list
+  uint16_t kind;   // RecordKind
+  uint32_t length; // Payload bytes, before padding
+};
+
+struct FlightLogTopic
+{
+  std::string name, datatype, md5sum, definition;
+};
+
+// Appends records to one chunk, which may be a chunk of a mapped file or a
+// pre-trigger buffer in memory
+class ChunkBuilder
+{
+private:
+  uint8_t *base;
+  uint32_t size;
+
+public:
+  ChunkBuilder() : base(0), size(0) {}
+
+  // Starts an empty chunk in size bytes at base
+  void start(uint8_t *chunk, uint32_t chunk_size, uint32_t sequence);
+  void finish() { base = 0; }
+  bool active() const { return base != 0; }
+  const ChunkHeader &header() const { return *reinterpret_cast<const ChunkHeader *>(base); }
+
+  // Space for a payload of length bytes, which the caller must fill; 0 if it
+  // does not fit in the rest of the chunk
+  uint8_t *reserve(uint64_t stamp, uint16_t topic, uint16_t kind, uint32_t length);
+
+  // Largest payload an empty chunk of chunk_size bytes holds
+  static uint32_t capacity(uint32_t chunk_size);
+};
+
+// Appends a RECORD_TOPIC record; false if it does not fit
+bool addTopicRecord(ChunkBuilder &chunk, uint64_t stamp, uint16_t topic, const FlightLogTopic &info);
+
+// A log file, preallocated and mapped. Chunks are written straight into the
+// mapping, so the kernel writes them back without any write() calls.
+class FlightLogWriter
+{
+private:
+  int fd;
+  uint8_t *map;
+  size_t map_size;
+  uint32_t chunk_size;
+  uint32_t chunks;      // Chunks the file holds
+  uint32_t used_chunks;
+
+public:
+  FlightLogWriter();
+  ~FlightLogWriter() { close(); }
+
+  // Creates path, which must not exist yet, with room for chunks chunks; false
+  // with errno set on failure
+  bool open(const std::string &path, uint32_t chunk_size, uint32_t chunks, uint64_t created);
+  // Trims the unused chunks and closes the file
+  void close();
+  bool isOpen() const { return map != 0; }
+
+  // Memory of the next chunk, zeroed; 0 when the file is full
+  uint8_t *nextChunk();
+};
+
+// Reads a log written by FlightLogWriter
+class FlightLogReader
+{
+private:
+  int fd;
+  const uint8_t *map;
+  size_t map_size;
+  FlightLogHeader file_header;
+  std::vector<const ChunkHeader *> index; // Valid chunks, in file order
+  std::map<uint16_t, FlightLogTopic> topic_info;
+
+  // Read position
+  size_t chunk;
+  uint32_t offset;
+
+public:
+  struct Record
+  {
+    uint64_t stamp; // ns
+    uint16_t topic;
+    const uint8_t *data; // Serialized message, valid while the reader is open
+    uint32_t length;
+  };
+
+  FlightLogReader();
+  ~FlightLogReader() { close(); }
+
+  // Maps path and indexes its chunks; false with a message in error on failure
+  bool open(const std::string &path, std::string &error);
+  void close();
+
+  const FlightLogHeader &header() const { return file_header; }
+  size_t numChunks() const { return index.size(); }
+  const ChunkHeader &chunkHeader(size_t i) const { return *index[i]; }
+
+  // Moves to the first chunk that ends at or after stamp. Topics defined in
+  // skipped chunks are still read, so messages after stamp stay decodable.
+  void seek(uint64_t stamp);
+
+  // The next message record in file order; false at the end of the log
+  bool next(Record &record);
+
+  // Topics defined so far by RECORD_TOPIC records
+  const std::map<uint16_t, FlightLogTopic> &topics() const { return topic_info; }
+};
+
+#endif
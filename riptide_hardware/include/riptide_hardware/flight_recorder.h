@@ -0,0 +1,58 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "ros/ros.h"
+#include "topic_tools/shape_shifter.h"
+#include "riptide_msgs/SwitchState.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include <string>
+#include <vector>
+#include "riptide_hardware/flight_log.h"
+
+class FlightRecorder
+{
+private:
+  ros::NodeHandle nh;
+  std::vector<ros::Subscriber> subs;
+  ros::Subscriber switch_sub;
+  ros::Publisher diag_pub;
+  ros::Timer status_timer;
+
+  // Topic list, in record topic order. Types are learned from each topic's first message.
+  std::vector<FlightLogTopic> topics;
+  std::vector<bool> topic_known;
+  std::vector<bool> topic_written; // Topic record already in the current file (or ring chunk)
+
+  std::string prefix;
+  int file_number;
+  uint32_t chunk_size, file_chunks;
+  FlightLogWriter writer;
+  ChunkBuilder chunk;
+  uint32_t sequence;
+
+  // Triggered mode: messages go round a ring of chunks in memory until the
+  // kill switch trips, then the ring and the next post_trigger seconds go to a file
+  bool continuous;
+  std::vector<uint8_t> ring;
+  uint32_t ring_chunks, ring_head, ring_count; // ring_head is the next chunk to use
+  double post_trigger;
+  ros::Time stop_time;
+  bool last_kill;
+
+  uint64_t messages, dropped, bytes;
+
+  bool openFile();
+  void closeFile();
+  bool nextChunk();
+  uint8_t *reserve(uint64_t stamp, uint16_t topic, uint32_t length);
+  void trigger();
+
+public:
+  FlightRecorder();
+  void messageCB(const ros::MessageEvent<topic_tools::ShapeShifter const> &event, uint16_t topic);
+  void switchCB(const riptide_msgs::SwitchState::ConstPtr &state);
+  void statusCB(const ros::TimerEvent &event);
+  void loop();
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef IMU_FILTER_H
+#define IMU_FILTER_H
+
+#include <string>
+#include <vector>
+
+#define IMU_CHANNELS 6         // ang_v x, y, z, then linear_accel x, y, z
+#define IMU_FILTER_MAX_TAPS 31
+
+// Low-pass stage for the IMU's angular velocity and linear acceleration. Either
+// an FIR filter with arbitrary taps or a 2nd-order Butterworth IIR filter, run
+// on all six channels at once: every loop runs across a padded row of channels,
+// so the compiler vectorizes it.
+class ImuFilter
+{
+public:
+  enum Type { NONE, FIR, IIR };
+
+private:
+  static const int LANES = 8; // IMU_CHANNELS padded to whole vectors
+
+  Type type;
+  int delay;
+  bool primed;
+
+  // FIR: taps, and the last num_taps inputs in a circular line
+  int num_taps;
+  int pos; // Row of line holding the newest input
+  alignas(32) double taps[IMU_FILTER_MAX_TAPS];
+  alignas(32) double line[IMU_FILTER_MAX_TAPS][LANES];
+
+  // IIR: biquad coefficients and transposed direct form II state
+  double b0, b1, b2, a1, a2;
+  alignas(32) double z1[LANES];
+  alignas(32) double z2[LANES];
+
+  void prime(const double x[LANES]);
+
+public:
+  ImuFilter();
+
+  // Each returns an error message, empty on success, and leaves the filter
+  // unchanged on failure. Taps are normalized to unity gain at DC.
+  std::string setFir(const std::vector<double> &fir_taps);
+  std::string setButterworth(double cutoff, double sample_rate);
+  void setNone();
+
+  // Filters one sample of every channel in place. The first sample after a
+  // change of filter sets the state as if it had always been the input.
+  void apply(double x[IMU_CHANNELS]);
+  void reset() { primed = false; }
+
+  // Samples by which the output lags the input, rounded: the tap centroid for
+  // FIR filters, 0 for IIR and no filtering
+  int getDelay() const { return delay; }
+  Type getType() const { return type; }
+};
+
+#endif
@@ -32,26 +32,26 @@
 #include "imu_3dm_gx4/MagFieldCF.h"
 #include "std_msgs/Header.h"
 #include "math.h"
-#include "stdio.h"
+#include "stdlib.h"
 #include "string"
 #include "fstream"
 #include <boost/lexical_cast.hpp>
+#include <memory>
+#include "riptide_hardware/spin_monitor.h"
+#include "riptide_hardware/binary_logger.h"
 
 class IMULogger
 {
 private:
   ros::NodeHandle nh;
   ros::Subscriber mag_sub;
+  SpinMonitor monitor;
 
-  FILE *fid;
-  const char *file_name_c;
-  double tStart, tNow; //MUST use type-DOUBLE for storing ros::Time
-  bool initialized;
+  std::unique_ptr<BinaryLogger> logger;
 public:
   IMULogger(char **argv);
   void magLogger(const imu_3dm_gx4::MagFieldCF::ConstPtr& mag);
   void loop();
-  char* convert(const std::string& str);
 };
 
 #endif
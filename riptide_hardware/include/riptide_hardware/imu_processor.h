@@ -8,6 +8,29 @@
 #include "imu_3dm_gx4/FilterOutput.h"
 #include "imu_3dm_gx4/MagFieldCF.h"
 #include "math.h"
+#include "riptide_hardware/ring_buffer.h"
+#include "riptide_hardware/imu_filter.h"
+#include "riptide_hardware/spin_monitor.h"
+
+#define IMU_HISTORY 64 // Samples kept: the longest filter delay, plus two for angular acceleration
+
+struct ImuVector
+{
+  double x, y, z;
+};
+
+// One filter output as it moves through the processing stages. Plain data, so
+// the history holds no strings; messages are only built when publishing.
+struct ImuSample
+{
+  uint32_t seq;
+  ros::Time stamp;
+  ImuVector raw_euler_rpy, euler_rpy, gyro_bias; // [deg]
+  double heading, heading_update, heading_update_uncertainty, heading_update_source, heading_update_flags;
+  ImuVector raw_linear_accel, linear_accel;
+  ImuVector raw_ang_v, ang_v, ang_accel;
+  double euler_rpy_status, ang_v_status, linear_accel_status;
+};
 
 class IMUProcessor
 {
@@ -16,32 +39,36 @@ private:
   ros::Subscriber imu_filter_sub, imu_mag_sub;
   ros::Publisher imu_verbose_state_pub;
   ros::Publisher imu_state_pub;
-  int cycles;
-  int c; //Center index for arrays
-  int size; //Size of state array
+  SpinMonitor monitor;
+  unsigned c; //Age of the sample the smoothed values line up with (the filter delay)
+  ImuVector lever_arm; //IMU position from the center of mass [m]
   float zero_ang_vel_thresh; //Threshold for zero angular veocity [deg/s]
 
-  //Shorthand matrices for data smoothing
-  //"av" = "Angular Velocity"
-  //"la" = "Linear Acceleration"
-  float av[3][7], la[3][7];
-
-  //0 = current state, 1 = one state ago, 2 = two states ago, etc.
+  //[0] = current state, [1] = one state ago, [2] = two states ago, etc.
   //Only velocities and accelerations will be smoothed
-  riptide_msgs::ImuVerbose state[7]; //Used for calculations, debugging, etc.
+  ImuFilter filter;
+  RingBuffer<ImuSample, IMU_HISTORY> history;
+  riptide_msgs::ImuVerbose verbose_state; //Used for calculations, debugging, etc.
   riptide_msgs::Imu imu_state; //Used for the controllers
-  float magBX, magBY, magBZ, mBX, mBY, mBZ, mWX, mWY, lastRoll, lastPitch, heading;
+  float magBX, magBY, magBZ, mBX, mBY, mBZ, mWX, mWY, heading;
+  ros::Time mag_stamp;
+  bool mag_pending; //Magnetometer sample newer than the newest filter sample
   double latitude, longitude, altitude, declination;
 public:
   IMUProcessor(char **argv);
   //void callback(const imu_3dm_gx4::FilterOutput::ConstPtr& filter_msg);
   void magCallback(const imu_3dm_gx4::MagFieldCF::ConstPtr& mag_msg);
+  bool tiltAt(const ros::Time &t, float &roll, float &pitch);
+  void fuseMag();
   void norm(float v1, float v2, float v3, float *x, float *y, float *z);
   void filterCallback(const imu_3dm_gx4::FilterOutput::ConstPtr& filter_msg);
-  void cvtRad2Deg();
-  void processEulerAngles();
+  void cvtRad2Deg(ImuSample &sample);
+  void processEulerAngles(ImuSample &sample);
+  void loadFilter();
   void smoothData();
-  void populateIMUState();
+  void processAngularAccel();
+  void processLinearAccel();
+  void populateIMUState(const ImuSample &sample);
   void loop();
 };
 
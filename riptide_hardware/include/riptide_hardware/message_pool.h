@@ -0,0 +1,51 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+// Messages for publishing by shared pointer, allocated up front. roscpp hands
+// a shared pointer straight to subscribers in the same process and serializes
+// for the others during publish(), so a message can be refilled as soon as no
+// subscriber queue or callback holds it any more. The pool grows when every
+// message is still held, which only happens if subscribers fall behind.
+//
+// Fill the message from get() and publish it; it must not be touched after
+// that. Not thread safe: use one pool per publishing thread.
+template <class M>
+class MessagePool
+{
+private:
+  std::vector<boost::shared_ptr<M> > messages;
+  size_t next;
+  unsigned long grown;
+
+public:
+  explicit MessagePool(size_t size = 4) : next(0), grown(0)
+  {
+    messages.reserve(size);
+    for (size_t i = 0; i < size; i++)
+      messages.push_back(boost::make_shared<M>());
+  }
+
+  // Round robin, so a message released late is not the next one retried
+  boost::shared_ptr<M> get()
+  {
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      boost::shared_ptr<M> &m = messages[next];
+      next = (next + 1) % messages.size();
+      if (m.use_count() == 1)
+        return m;
+    }
+    grown++;
+    messages.push_back(boost::make_shared<M>());
+    return messages.back();
+  }
+
+  size_t size() const { return messages.size(); }
+  unsigned long getGrown() const { return grown; }
+};
+
+#endif
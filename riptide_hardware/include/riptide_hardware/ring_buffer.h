@@ -0,0 +1,36 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+// Fixed-capacity history indexed by age: [0] is the newest sample, [1] the one
+// before it, and so on. push() overwrites the oldest sample once full, so no
+// sample is ever copied after it is written. N must be a power of two.
+template <typename T, unsigned N>
+class RingBuffer
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+private:
+  T samples[N];
+  unsigned head; // Index of the newest sample
+  unsigned count;
+
+public:
+  RingBuffer() : head(N - 1), count(0) {}
+
+  // Slot for a new sample, which becomes [0]
+  T &push()
+  {
+    head = (head + 1) & (N - 1);
+    if (count < N)
+      count++;
+    return samples[head];
+  }
+
+  T &operator[](unsigned age) { return samples[(head - age) & (N - 1)]; }
+  const T &operator[](unsigned age) const { return samples[(head - age) & (N - 1)]; }
+
+  unsigned size() const { return count; }
+  static unsigned capacity() { return N; }
+};
+
+#endif
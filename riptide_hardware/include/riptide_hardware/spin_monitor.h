@@ -0,0 +1,37 @@
+#ifndef SPIN_MONITOR_H
+#define SPIN_MONITOR_H
+
+#include "ros/ros.h"
+#include <string>
+
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+// Wake-up and latency statistics for a node that runs everything from
+// callbacks in ros::spin(), published on /diagnostics once a second. Not
+// thread safe: call it from the spinning thread only.
+class SpinMonitor
+{
+private:
+  ros::Publisher diag_pub;
+  ros::WallTimer timer;
+  std::string name;
+
+  long callbacks;
+  long samples;
+  double latency_sum, latency_max; // s
+  long last_switches;              // Voluntary context switches of the spinning thread
+  ros::WallTime last_report;
+
+  void report(const ros::WallTimerEvent &event);
+
+public:
+  SpinMonitor(ros::NodeHandle &nh, const std::string &name);
+
+  // Call at the start of every callback
+  void wake() { callbacks++; }
+
+  // Call once a sample stamped stamp has been published, or otherwise handled
+  void handled(const ros::Time &stamp);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// Lock-free queue of fixed-size records for exactly one producer thread and one
+// consumer thread. Records are copied in and out of preallocated slots, so
+// neither side ever allocates or blocks.
+class SpscQueue
+{
+private:
+  std::vector<unsigned char> slots;
+  size_t record_size;
+  size_t mask; // Capacity - 1
+
+  // Padded onto separate cache lines so the two threads do not contend. Padding
+  // rather than alignas, which plain new does not honour before C++17.
+  char pad0[64];
+  std::atomic<size_t> head; // Next slot to write, owned by the producer
+  char pad1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail; // Next slot to read, owned by the consumer
+  char pad2[64 - sizeof(std::atomic<size_t>)];
+
+public:
+  // Capacity is rounded up to a power of two
+  SpscQueue(size_t record_size, size_t capacity) : record_size(record_size), head(0), tail(0)
+  {
+    size_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+    mask = n - 1;
+    slots.resize(n * record_size);
+  }
+
+  // Producer: false, and the record is dropped, when the queue is full
+  bool push(const void *record)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask)
+      return false;
+    memcpy(&slots[(h & mask) * record_size], record, record_size);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: false when the queue is empty
+  bool pop(void *record)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false;
+    memcpy(record, &slots[(t & mask) * record_size], record_size);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: true when there is nothing to pop
+  bool empty() const { return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire); }
+
+  size_t recordSize() const { return record_size; }
+};
+
+#endif
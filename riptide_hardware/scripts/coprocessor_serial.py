@@ -37,8 +37,8 @@ def main():
     rospy.init_node('coprocessor_serial')
     dataRead = True
 
-    # Add publishers
-    depthPub = rospy.Publisher('/state/depth', Depth, queue_size=1)
+    # Add publishers. Depth is raw; depth_processor filters it onto /state/depth
+    depthPub = rospy.Publisher('/arduino/depth', Depth, queue_size=1)
     swPub = rospy.Publisher('/state/switches', SwitchState, queue_size=1)
 
     #Subscribe to Thruster PWMs
@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+# Converts binary logs written by BinaryLogger (binary_logger.h) to CSV.
+#
+# Usage: log_to_csv.py [-o out.csv] log_0.bin [log_1.bin ...]
+#
+# Files are read in the order given, so pass a rotated log's files in number
+# order. The first column is the time in seconds since the first record, as in
+# the CSVs imu_logger used to write.
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<8sIIIIQ')
+MAGIC = b'RIPTLOG'
+VERSION = 1
+
+# record_type: (name, struct format, CSV columns after time), matching LOG_RECORD_*
+RECORD_TYPES = {
+    1: ('mag', '<QfffI', ['x', 'y', 'z']),
+}
+
+
+def read_records(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError('%s: too short for a log header' % path)
+    magic, version, record_type, record_size, _, records = HEADER.unpack_from(data)
+    if magic.rstrip(b'\0') != MAGIC or version != VERSION:
+        raise ValueError('%s: not a version %d log' % (path, VERSION))
+    if record_type not in RECORD_TYPES:
+        raise ValueError('%s: unknown record type %d' % (path, record_type))
+    name, fmt, columns = RECORD_TYPES[record_type]
+    record = struct.Struct(fmt)
+    if record.size != record_size:
+        raise ValueError('%s: %s records are %d bytes, expected %d' % (path, name, record_size, record.size))
+
+    # records is 0 when the logger died; the data then ends at the first all-zero record
+    end = HEADER.size + record_size * records if records else len(data)
+    zero = b'\0' * record_size
+    out = []
+    for offset in range(HEADER.size, end - record_size + 1, record_size):
+        raw = data[offset:offset + record_size]
+        if not records and raw == zero:
+            break
+        out.append(record.unpack(raw))
+    return record_type, columns, out
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert BinaryLogger logs to CSV')
+    parser.add_argument('logs', nargs='+', help='log files, in rotation order')
+    parser.add_argument('-o', '--output', help='CSV file (default: stdout)')
+    args = parser.parse_args()
+
+    rows = []
+    columns = None
+    record_type = None
+    for path in args.logs:
+        t, cols, records = read_records(path)
+        if record_type is not None and t != record_type:
+            sys.exit('%s: record type %d does not match the earlier files' % (path, t))
+        record_type, columns = t, cols
+        rows.extend(records)
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    out.write(','.join(['time'] + columns) + '\n')
+    start = rows[0][0] if rows else 0
+    for r in rows:
+        values = ['%f' % ((r[0] - start) * 1e-9)] + ['%f' % v for v in r[1:1 + len(columns)]]
+        out.write(','.join(values) + '\n')
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,223 @@
+#include "riptide_hardware/binary_logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <vector>
+
+#define WRITE_BATCH 256 // Records per write()
+#define RETRY_MIN_S 1   // Back-off after a failed open or write, doubled on each failure
+#define RETRY_MAX_S 60
+
+BinaryLogger::BinaryLogger(const std::string &prefix, uint32_t record_type, size_t record_size,
+                           size_t queue_records, size_t file_bytes)
+  : queue(record_size, queue_records), prefix(prefix), record_type(record_type), file_number(0), fd(-1),
+    wake_fd(eventfd(0, EFD_CLOEXEC)), file_records(0), retry_s(0), dropped_records(0), written_records(0),
+    stopping(false), sleeping(false)
+{
+  // At least one record per file
+  this->file_bytes = std::max(file_bytes, sizeof(LogFileHeader) + record_size);
+  if (wake_fd < 0)
+    fprintf(stderr, "BinaryLogger: cannot create eventfd: %s, not logging\n", strerror(errno));
+  else
+    writer = std::thread(&BinaryLogger::writerLoop, this);
+}
+
+BinaryLogger::~BinaryLogger()
+{
+  stopping = true;
+  if (writer.joinable())
+  {
+    wake();
+    writer.join();
+  }
+  if (wake_fd >= 0)
+    close(wake_fd);
+}
+
+// Adding to an eventfd's counter never blocks short of 2^64 wake-ups
+void BinaryLogger::wake()
+{
+  uint64_t one = 1;
+  if (write(wake_fd, &one, sizeof(one)) != sizeof(one))
+    fprintf(stderr, "BinaryLogger: cannot wake writer: %s\n", strerror(errno));
+}
+
+// The fence pairs with the one in writerLoop(): either the writer sees the new
+// record before it sleeps, or this sees it asleep and wakes it
+bool BinaryLogger::log(const void *record)
+{
+  if (wake_fd >= 0 && queue.push(record))
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false))
+      wake();
+    return true;
+  }
+  dropped_records++;
+  return false;
+}
+
+// Opens the first unused <prefix>_<n>.bin at or after file_number
+bool BinaryLogger::openFile()
+{
+  std::string name;
+  for (;; file_number++)
+  {
+    name = prefix + "_" + std::to_string(file_number) + ".bin";
+    fd = open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0 || errno != EEXIST)
+      break;
+  }
+  if (fd < 0)
+  {
+    fprintf(stderr, "BinaryLogger: cannot create %s: %s\n", name.c_str(), strerror(errno));
+    return false;
+  }
+  file_number++;
+
+  // Preallocating keeps the file's blocks together and metadata updates out of every write.
+  // No room for the file is fatal for it; a filesystem without fallocate is not.
+  int err = posix_fallocate(fd, 0, file_bytes);
+  if (err == ENOSPC || err == EFBIG)
+  {
+    fprintf(stderr, "BinaryLogger: cannot allocate %s: %s\n", name.c_str(), strerror(err));
+    close(fd);
+    fd = -1;
+    unlink(name.c_str());
+    return false;
+  }
+
+  LogFileHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, "RIPTLOG", sizeof(header.magic));
+  header.version = LOG_VERSION;
+  header.record_type = record_type;
+  header.record_size = queue.recordSize();
+  if (write(fd, &header, sizeof(header)) != sizeof(header))
+  {
+    fprintf(stderr, "BinaryLogger: cannot write %s: %s\n", name.c_str(), strerror(errno));
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  file_records = 0;
+  return true;
+}
+
+// Records the final count and trims the unused preallocation
+void BinaryLogger::closeFile()
+{
+  if (fd < 0)
+    return;
+  if (pwrite(fd, &file_records, sizeof(file_records), offsetof(LogFileHeader, records)) != sizeof(file_records))
+    fprintf(stderr, "BinaryLogger: cannot write record count: %s\n", strerror(errno));
+  if (ftruncate(fd, sizeof(LogFileHeader) + file_records * queue.recordSize()) != 0)
+    fprintf(stderr, "BinaryLogger: cannot trim log: %s\n", strerror(errno));
+  fdatasync(fd);
+  close(fd);
+  fd = -1;
+}
+
+// Stops writing for retry_s, doubling it on each failure in a row, so a full
+// or failing disk costs one attempt per back-off rather than one per batch
+void BinaryLogger::fail()
+{
+  retry_s = retry_s == 0 ? RETRY_MIN_S : std::min(2 * retry_s, RETRY_MAX_S);
+  retry_at = std::chrono::steady_clock::now() + std::chrono::seconds(retry_s);
+  fprintf(stderr, "BinaryLogger: dropping records for %d s\n", retry_s);
+}
+
+void BinaryLogger::writeRecords(const unsigned char *records, size_t n)
+{
+  size_t record_size = queue.recordSize();
+  size_t per_file = (file_bytes - sizeof(LogFileHeader)) / record_size;
+  if (retry_s > 0 && std::chrono::steady_clock::now() < retry_at)
+  {
+    dropped_records += n;
+    return;
+  }
+  while (n > 0)
+  {
+    if (fd >= 0 && file_records >= per_file)
+      closeFile();
+    if (fd < 0 && !openFile())
+    {
+      fail();
+      dropped_records += n;
+      return;
+    }
+
+    // Written at the offset of the next record, so a short write cannot shift
+    // the records after it
+    size_t count = std::min(n, static_cast<size_t>(per_file - file_records));
+    size_t bytes = count * record_size;
+    off_t offset = sizeof(LogFileHeader) + file_records * record_size;
+    size_t done = 0;
+    while (done < bytes)
+    {
+      ssize_t w = pwrite(fd, records + done, bytes - done, offset + done);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+        break;
+      done += w;
+    }
+    if (done < bytes)
+    {
+      // Close the file at its last whole record and retry in a new one later
+      fprintf(stderr, "BinaryLogger: write failed: %s\n", strerror(errno));
+      closeFile();
+      fail();
+      dropped_records += n;
+      return;
+    }
+    retry_s = 0;
+    file_records += count;
+    written_records += count;
+    records += bytes;
+    n -= count;
+  }
+}
+
+// Drains the queue in batches, blocked on the eventfd while it is empty. The
+// sleeping flag is raised before the last empty check, and the counter keeps a
+// wake-up that arrives before the read. Stops once the queue is empty after the
+// destructor asked it to.
+void BinaryLogger::writerLoop()
+{
+  std::vector<unsigned char> batch(WRITE_BATCH * queue.recordSize());
+  while (true)
+  {
+    size_t n = 0;
+    while (n < WRITE_BATCH && queue.pop(&batch[n * queue.recordSize()]))
+      n++;
+
+    if (n > 0)
+      writeRecords(batch.data(), n);
+    else if (stopping)
+      break;
+    else
+    {
+      sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!queue.empty())
+      {
+        sleeping.store(false, std::memory_order_relaxed);
+        continue;
+      }
+      uint64_t count;
+      if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EINTR)
+      {
+        fprintf(stderr, "BinaryLogger: cannot wait for records: %s\n", strerror(errno));
+        break;
+      }
+    }
+  }
+  closeFile();
+}
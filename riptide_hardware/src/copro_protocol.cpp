@@ -0,0 +1,161 @@
+#include "riptide_hardware/copro_protocol.h"
+
+#include <string.h>
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static void putFloat(uint8_t *p, float f)
+{
+  uint32_t v;
+  memcpy(&v, &f, sizeof(v));
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static float getFloat(const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+  float f;
+  memcpy(&f, &v, sizeof(f));
+  return f;
+}
+
+uint16_t coproCrc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+size_t coproPayloadSize(uint8_t type)
+{
+  switch (type)
+  {
+  case COPRO_PWM:
+    return COPRO_PWM_PAYLOAD;
+  case COPRO_TELEMETRY:
+    return COPRO_TELEMETRY_PAYLOAD;
+  default:
+    return 0;
+  }
+}
+
+// Fills in the header and CRC around a payload already written at frame + COPRO_HEADER_SIZE
+static size_t finishFrame(uint8_t type, uint8_t seq, uint8_t *frame)
+{
+  size_t payload = coproPayloadSize(type);
+  frame[0] = COPRO_SYNC0;
+  frame[1] = COPRO_SYNC1;
+  frame[2] = type;
+  frame[3] = seq;
+  put16(frame + COPRO_HEADER_SIZE + payload, coproCrc16(frame + 2, 2 + payload));
+  return COPRO_HEADER_SIZE + payload + COPRO_CRC_SIZE;
+}
+
+size_t encodePwmFrame(uint8_t seq, const uint16_t pwm[COPRO_PWM_CHANNELS], uint8_t *frame)
+{
+  for (int i = 0; i < COPRO_PWM_CHANNELS; i++)
+    put16(frame + COPRO_HEADER_SIZE + 2 * i, pwm[i]);
+  return finishFrame(COPRO_PWM, seq, frame);
+}
+
+size_t encodeTelemetryFrame(uint8_t seq, const CoproTelemetry &telemetry, uint8_t *frame)
+{
+  uint8_t *p = frame + COPRO_HEADER_SIZE;
+  p[0] = telemetry.switches;
+  p[1] = telemetry.count;
+  put16(p + 2, telemetry.period_us);
+  for (int i = 0; i < COPRO_DEPTH_BATCH; i++)
+  {
+    putFloat(p + 4 + 12 * i, telemetry.depth[i].depth);
+    putFloat(p + 8 + 12 * i, telemetry.depth[i].pressure);
+    putFloat(p + 12 + 12 * i, telemetry.depth[i].temp);
+  }
+  return finishFrame(COPRO_TELEMETRY, seq, frame);
+}
+
+void decodePwm(const uint8_t *payload, uint16_t pwm[COPRO_PWM_CHANNELS])
+{
+  for (int i = 0; i < COPRO_PWM_CHANNELS; i++)
+    pwm[i] = get16(payload + 2 * i);
+}
+
+void decodeTelemetry(const uint8_t *payload, CoproTelemetry &telemetry)
+{
+  telemetry.switches = payload[0];
+  telemetry.count = payload[1] < COPRO_DEPTH_BATCH ? payload[1] : COPRO_DEPTH_BATCH;
+  telemetry.period_us = get16(payload + 2);
+  for (int i = 0; i < COPRO_DEPTH_BATCH; i++)
+  {
+    telemetry.depth[i].depth = getFloat(payload + 4 + 12 * i);
+    telemetry.depth[i].pressure = getFloat(payload + 8 + 12 * i);
+    telemetry.depth[i].temp = getFloat(payload + 12 + 12 * i);
+  }
+}
+
+CoproParser::CoproParser() : length(0), expected(0), have_seq(false), last_seq(0), frames(0), crc_errors(0), lost(0)
+{
+}
+
+bool CoproParser::push(uint8_t byte)
+{
+  // Hunt for the sync bytes
+  if (length == 0)
+  {
+    if (byte == COPRO_SYNC0)
+      buffer[length++] = byte;
+    return false;
+  }
+  if (length == 1)
+  {
+    if (byte == COPRO_SYNC1)
+      buffer[length++] = byte;
+    else
+      length = byte == COPRO_SYNC0 ? 1 : 0;
+    return false;
+  }
+
+  buffer[length++] = byte;
+  if (length == 3)
+  {
+    size_t payload = coproPayloadSize(byte);
+    if (payload == 0)
+    {
+      length = 0;
+      return false;
+    }
+    expected = COPRO_HEADER_SIZE + payload + COPRO_CRC_SIZE;
+  }
+  if (length < COPRO_HEADER_SIZE || length < expected)
+    return false;
+
+  // Complete frame. After a bad CRC, hunting restarts from the next byte.
+  length = 0;
+  size_t payload = expected - COPRO_HEADER_SIZE - COPRO_CRC_SIZE;
+  if (coproCrc16(buffer + 2, 2 + payload) != get16(buffer + COPRO_HEADER_SIZE + payload))
+  {
+    crc_errors++;
+    return false;
+  }
+
+  if (have_seq)
+    lost += static_cast<uint8_t>(seq() - last_seq - 1);
+  have_seq = true;
+  last_seq = seq();
+  frames++;
+  return true;
+}
@@ -0,0 +1,222 @@
+#include "riptide_hardware/coprocessor_driver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/file.h>
+#include <termios.h>
+#include <unistd.h>
+
+CoprocessorDriver::CoprocessorDriver() : CoprocessorDriver(ros::NodeHandle())
+{
+}
+
+//node is the nodelet's handle when run as a nodelet. A port that cannot be
+//opened is retried from Loop() rather than shutting down, which would take the
+//rest of a nodelet manager with it.
+CoprocessorDriver::CoprocessorDriver(const ros::NodeHandle &node)
+  : nh(node), fd(-1), tx_seq(0), reported_errors(0), running(true)
+{
+  nh.setCallbackQueue(&queue);
+  ros::NodeHandle cdp(nh, "coprocessor_driver");
+  cdp.param<std::string>("port", port, "/dev/copro");
+  cdp.param<int>("baud", baud, 9600);
+
+  if (openPort())
+    ROS_INFO("Coprocessor on %s at %d baud", port.c_str(), baud);
+  else
+  {
+    ROS_ERROR("Cannot open coprocessor on %s: %s, retrying", port.c_str(), strerror(errno));
+    next_reopen = ros::WallTime::now() + ros::WallDuration(1.0);
+  }
+
+  depth_pub = nh.advertise<riptide_msgs::Depth>("/arduino/depth", 1);
+  switch_pub = nh.advertise<riptide_msgs::SwitchState>("/state/switches", 1);
+  pwm_sub = nh.subscribe<riptide_msgs::PwmStamped>("/command/pwm", 1, &CoprocessorDriver::PwmCB, this);
+}
+
+CoprocessorDriver::~CoprocessorDriver()
+{
+  stop();
+  if (fd >= 0)
+    close(fd);
+}
+
+// Raw 8N1 at the configured baud rate. The port is locked, so a second driver
+// (the node next to the nodelet, say) fails to open it instead of splitting the
+// telemetry stream with this one.
+bool CoprocessorDriver::openPort()
+{
+  speed_t speed;
+  switch (baud)
+  {
+  case 9600: speed = B9600; break;
+  case 19200: speed = B19200; break;
+  case 38400: speed = B38400; break;
+  case 57600: speed = B57600; break;
+  case 115200: speed = B115200; break;
+  case 230400: speed = B230400; break;
+  case 460800: speed = B460800; break;
+  case 921600: speed = B921600; break;
+  default:
+    errno = EINVAL;
+    return false;
+  }
+
+  fd = open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+    return false;
+
+  termios tty;
+  bool ok = flock(fd, LOCK_EX | LOCK_NB) == 0;
+  if (!ok)
+    errno = EBUSY;
+  else
+    ok = tcgetattr(fd, &tty) == 0;
+  if (ok)
+  {
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~CSTOPB;
+    ok = tcsetattr(fd, TCSANOW, &tty) == 0 && tcflush(fd, TCIOFLUSH) == 0;
+  }
+  if (!ok)
+  {
+    int error = errno;
+    close(fd);
+    fd = -1;
+    errno = error;
+  }
+  return ok;
+}
+
+// After a hang-up the port is reopened once a second until the device is back
+void CoprocessorDriver::closePort(const char *reason)
+{
+  ROS_ERROR("Coprocessor on %s lost (%s), reconnecting", port.c_str(), reason);
+  close(fd);
+  fd = -1;
+  next_reopen = ros::WallTime::now() + ros::WallDuration(1.0);
+}
+
+void CoprocessorDriver::PwmCB(const riptide_msgs::PwmStamped::ConstPtr &msg)
+{
+  if (fd < 0)
+    return; // Reconnecting
+  const riptide_msgs::Pwm &p = msg->pwm;
+  int16_t fields[COPRO_PWM_CHANNELS] = { p.surge_port_hi,  p.surge_stbd_hi,  p.surge_port_lo,  p.surge_stbd_lo,
+                                         p.sway_fwd,       p.sway_aft,       p.heave_port_fwd, p.heave_stbd_fwd,
+                                         p.heave_port_aft, p.heave_stbd_aft };
+  uint16_t pwm[COPRO_PWM_CHANNELS];
+  for (int i = 0; i < COPRO_PWM_CHANNELS; i++)
+    pwm[i] = fields[i] > 0 ? fields[i] : 0;
+  uint8_t frame[COPRO_MAX_FRAME];
+  size_t len = encodePwmFrame(tx_seq++, pwm, frame);
+
+  // A frame is far smaller than the tty buffer, so a short write means the
+  // coprocessor stopped reading; drop the frame rather than block the node
+  if (write(fd, frame, len) != static_cast<ssize_t>(len))
+    ROS_WARN_THROTTLE(5, "Coprocessor write failed, dropping PWM frames");
+}
+
+// Depth samples are stamped back from the arrival time at the sample period
+void CoprocessorDriver::handleTelemetry(const CoproTelemetry &telemetry, const ros::Time &received)
+{
+  for (int i = 0; i < telemetry.count; i++)
+  {
+    boost::shared_ptr<riptide_msgs::Depth> depth = depth_pool.get();
+    depth->header.stamp = received - ros::Duration(1e-6 * telemetry.period_us * (telemetry.count - 1 - i));
+    depth->depth = telemetry.depth[i].depth;
+    depth->pressure = telemetry.depth[i].pressure;
+    depth->temp = telemetry.depth[i].temp;
+    depth->altitude = 0.0;
+    depth_pub.publish(depth);
+  }
+
+  riptide_msgs::SwitchState sw;
+  sw.header.stamp = received;
+  sw.kill = telemetry.switches & COPRO_KILL;
+  sw.sw1 = telemetry.switches & (COPRO_KILL << 1);
+  sw.sw2 = telemetry.switches & (COPRO_KILL << 2);
+  sw.sw3 = telemetry.switches & (COPRO_KILL << 3);
+  sw.sw4 = telemetry.switches & (COPRO_KILL << 4);
+  sw.sw5 = telemetry.switches & (COPRO_KILL << 5);
+  switch_pub.publish(sw);
+}
+
+// Waits on the port for at most 10 ms at a time so PWM commands are still
+// forwarded promptly when no telemetry arrives
+void CoprocessorDriver::Loop()
+{
+  uint8_t buf[256];
+  while (running && ros::ok())
+  {
+    if (fd < 0)
+    {
+      if (ros::WallTime::now() >= next_reopen)
+      {
+        if (openPort())
+          ROS_INFO("Coprocessor on %s reconnected", port.c_str());
+        else
+          next_reopen = ros::WallTime::now() + ros::WallDuration(1.0);
+      }
+      if (fd < 0)
+      {
+        ros::WallDuration(0.01).sleep();
+        queue.callAvailable();
+        continue;
+      }
+    }
+
+    pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 10) > 0)
+    {
+      // A hang-up (USB unplugged) polls ready forever, so it has to close the port
+      if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+      {
+        closePort(pfd.revents & POLLHUP ? "hang-up" : "port error");
+        continue;
+      }
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+      {
+        closePort(n == 0 ? "end of file" : strerror(errno));
+        continue;
+      }
+      ros::Time received = ros::Time::now();
+      for (ssize_t i = 0; i < n; i++)
+      {
+        if (parser.push(buf[i]) && parser.type() == COPRO_TELEMETRY)
+        {
+          CoproTelemetry telemetry;
+          decodeTelemetry(parser.payload(), telemetry);
+          handleTelemetry(telemetry, received);
+        }
+      }
+
+      if (parser.crc_errors + parser.lost > reported_errors)
+      {
+        ROS_WARN_THROTTLE(5, "Coprocessor link: %lu frames, %lu CRC errors, %lu lost", parser.frames,
+                          parser.crc_errors, parser.lost);
+        reported_errors = parser.crc_errors + parser.lost;
+      }
+    }
+    queue.callAvailable();
+  }
+}
+
+void CoprocessorDriver::start()
+{
+  running = true;
+  loop_thread = std::thread(&CoprocessorDriver::Loop, this);
+}
+
+void CoprocessorDriver::stop()
+{
+  running = false;
+  if (loop_thread.joinable())
+    loop_thread.join();
+}
@@ -0,0 +1,8 @@
+#include "riptide_hardware/coprocessor_driver.h"
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "coprocessor_driver");
+  CoprocessorDriver driver;
+  driver.Loop();
+}
@@ -0,0 +1,30 @@
+// coprocessor_driver as a nodelet. Loaded into the same manager as
+// depth_processor, arduino/depth reaches it as the published pointer, so the
+// depth path from the serial port to thruster_controller makes no copies.
+
+#include "riptide_hardware/coprocessor_driver.h"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+class CoprocessorDriverNodelet : public nodelet::Nodelet
+{
+private:
+  boost::shared_ptr<CoprocessorDriver> driver;
+
+  // The driver blocks on the port, so it runs on its own thread rather than
+  // the manager's workers
+  void onInit()
+  {
+    driver.reset(new CoprocessorDriver(getNodeHandle()));
+    driver->start();
+  }
+
+public:
+  ~CoprocessorDriverNodelet()
+  {
+    if (driver)
+      driver->stop();
+  }
+};
+
+PLUGINLIB_EXPORT_CLASS(CoprocessorDriverNodelet, nodelet::Nodelet)
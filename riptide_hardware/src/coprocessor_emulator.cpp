@@ -0,0 +1,293 @@
+// Coprocessor emulator on a pseudo-terminal, for running coprocessor_driver
+// without the vehicle. Runs without a ROS master.
+//
+// Usage: coprocessor_emulator [rate] [corrupt]
+//        coprocessor_emulator --selftest [frames]
+//
+// The first form prints the pty path to pass as coprocessor_driver's port,
+// sends telemetry frames at rate Hz (default 50) with the kill switch inserted
+// and a slowly varying depth, and prints the PWM frames it receives once a second.
+// With corrupt > 0, every corrupt-th telemetry frame has a byte flipped so the
+// driver's CRC handling can be watched.
+//
+// --selftest sends PWM and telemetry frames both ways through a pty pair, with
+// line noise between frames and some frames corrupted or skipped, and checks
+// that every intact frame decodes to what was sent and that the parser counts
+// the rest. Exits non-zero on any mismatch.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "riptide_hardware/copro_protocol.h"
+
+// Opens a raw pty pair; returns the master fd and fills slave
+static int openPty(int &slave)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    return -1;
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0)
+    return -1;
+
+  termios tty;
+  tcgetattr(slave, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(slave, TCSANOW, &tty);
+  return master;
+}
+
+static double now()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void writeAll(int fd, const uint8_t *data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, data, len);
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+      return;
+    if (n > 0)
+    {
+      data += n;
+      len -= n;
+    }
+  }
+}
+
+// Feeds whatever arrives within timeout_ms to parser, appending each decoded
+// frame's type, seq and payload to frames
+static void readFrames(int fd, CoproParser &parser, int timeout_ms, std::vector<std::vector<uint8_t> > &frames)
+{
+  uint8_t buf[256];
+  pollfd pfd = { fd, POLLIN, 0 };
+  while (poll(&pfd, 1, timeout_ms) > 0)
+  {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return;
+    for (ssize_t i = 0; i < n; i++)
+    {
+      if (parser.push(buf[i]))
+      {
+        std::vector<uint8_t> frame(parser.payload() - 2, parser.payload() + coproPayloadSize(parser.type()));
+        frames.push_back(frame);
+      }
+    }
+    timeout_ms = 0;
+  }
+}
+
+static int selftest(int count)
+{
+  int slave;
+  int master = openPty(slave);
+  if (master < 0)
+  {
+    perror("pty");
+    return 1;
+  }
+
+  srand(1);
+  const uint8_t noise[] = { 0x00, COPRO_SYNC0, 0x13, COPRO_SYNC0, COPRO_SYNC1, 0xEE };
+  int failures = 0;
+
+  // Host to coprocessor: PWM. Every 7th frame is corrupted, every 11th never sent.
+  {
+    CoproParser parser;
+    std::vector<std::vector<uint8_t> > received;
+    std::vector<std::vector<uint16_t> > sent;
+    unsigned long corrupted = 0, skipped = 0;
+    for (int k = 0; k < count; k++)
+    {
+      uint16_t pwm[COPRO_PWM_CHANNELS];
+      for (int i = 0; i < COPRO_PWM_CHANNELS; i++)
+        pwm[i] = 1100 + rand() % 801;
+      uint8_t frame[COPRO_MAX_FRAME];
+      size_t len = encodePwmFrame(static_cast<uint8_t>(k), pwm, frame);
+
+      if (k % 11 == 5)
+      {
+        skipped++;
+        continue;
+      }
+      if (k % 7 == 3)
+      {
+        frame[COPRO_HEADER_SIZE + rand() % COPRO_PWM_PAYLOAD] ^= 0x40;
+        corrupted++;
+      }
+      else
+      {
+        sent.push_back(std::vector<uint16_t>(pwm, pwm + COPRO_PWM_CHANNELS));
+      }
+      writeAll(slave, noise, k % 3);
+      writeAll(slave, frame, len);
+      readFrames(master, parser, 0, received);
+    }
+    readFrames(master, parser, 100, received);
+
+    size_t n = std::min(sent.size(), received.size());
+    for (size_t k = 0; k < n; k++)
+    {
+      uint16_t pwm[COPRO_PWM_CHANNELS];
+      decodePwm(&received[k][2], pwm);
+      if (received[k][0] != COPRO_PWM || memcmp(pwm, &sent[k][0], sizeof(pwm)) != 0)
+        failures++;
+    }
+    if (sent.size() != received.size() || parser.crc_errors != corrupted)
+      failures++;
+    printf("pwm:       %4zu sent, %4zu received, %3lu/%3lu CRC errors, %3lu lost (%lu skipped or corrupted)\n",
+           sent.size(), received.size(), parser.crc_errors, corrupted, parser.lost, skipped + corrupted);
+  }
+
+  // Coprocessor to host: telemetry, exercising every field
+  {
+    CoproParser parser;
+    std::vector<std::vector<uint8_t> > received;
+    std::vector<CoproTelemetry> sent;
+    for (int k = 0; k < count; k++)
+    {
+      CoproTelemetry t;
+      t.switches = rand() & 0x3F;
+      t.count = 1 + rand() % COPRO_DEPTH_BATCH;
+      t.period_us = 10000;
+      for (int i = 0; i < COPRO_DEPTH_BATCH; i++)
+      {
+        t.depth[i].depth = rand() / static_cast<float>(RAND_MAX) * 5.0f;
+        t.depth[i].pressure = 1013.25f + t.depth[i].depth * 100.0f;
+        t.depth[i].temp = 20.0f - i;
+      }
+      uint8_t frame[COPRO_MAX_FRAME];
+      size_t len = encodeTelemetryFrame(static_cast<uint8_t>(k), t, frame);
+      sent.push_back(t);
+      writeAll(master, noise, k % 4);
+      writeAll(master, frame, len);
+      readFrames(slave, parser, 0, received);
+    }
+    readFrames(slave, parser, 100, received);
+
+    if (sent.size() != received.size() || parser.crc_errors != 0 || parser.lost != 0)
+      failures++;
+    size_t n = std::min(sent.size(), received.size());
+    for (size_t k = 0; k < n; k++)
+    {
+      CoproTelemetry t;
+      decodeTelemetry(&received[k][2], t);
+      const CoproTelemetry &s = sent[k];
+      bool same = received[k][0] == COPRO_TELEMETRY && t.switches == s.switches && t.count == s.count &&
+                  t.period_us == s.period_us;
+      for (int i = 0; i < COPRO_DEPTH_BATCH; i++)
+        same = same && t.depth[i].depth == s.depth[i].depth && t.depth[i].pressure == s.depth[i].pressure &&
+               t.depth[i].temp == s.depth[i].temp;
+      if (!same)
+        failures++;
+    }
+    printf("telemetry: %4zu sent, %4zu received, %3lu CRC errors, %3lu lost\n", sent.size(), received.size(),
+           parser.crc_errors, parser.lost);
+  }
+
+  // Line time per frame, against the old ASCII PWM string
+  int ascii = 4 + 4 * COPRO_PWM_CHANNELS + 4;
+  int binary = COPRO_HEADER_SIZE + COPRO_PWM_PAYLOAD + COPRO_CRC_SIZE;
+  printf("PWM frame %d bytes (ASCII %d): %.0f Hz max at 9600 baud (ASCII %.0f Hz)\n", binary, ascii,
+         960.0 / binary, 960.0 / ascii);
+
+  close(slave);
+  close(master);
+  printf("%s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
+
+static int emulate(double rate, int corrupt)
+{
+  int slave;
+  int master = openPty(slave);
+  if (master < 0)
+  {
+    perror("pty");
+    return 1;
+  }
+  // Keep the slave open so the pty survives the driver reconnecting
+  printf("Coprocessor emulator on %s\n", ptsname(master));
+  fflush(stdout);
+
+  CoproParser parser;
+  std::vector<std::vector<uint8_t> > received;
+  uint8_t seq = 0;
+  double start = now(), next_frame = start, next_report = start + 1;
+  double sample_period = 1.0 / (rate * COPRO_DEPTH_BATCH);
+  while (true)
+  {
+    int wait = static_cast<int>(1e3 * (next_frame - now()));
+    readFrames(master, parser, wait > 0 ? wait : 0, received);
+
+    double t = now();
+    if (t >= next_frame)
+    {
+      CoproTelemetry telemetry;
+      telemetry.switches = t - start > 1.0 ? COPRO_KILL : 0;
+      telemetry.count = COPRO_DEPTH_BATCH;
+      telemetry.period_us = static_cast<uint16_t>(1e6 * sample_period);
+      for (int i = 0; i < COPRO_DEPTH_BATCH; i++)
+      {
+        double ts = t - start - (COPRO_DEPTH_BATCH - 1 - i) * sample_period;
+        telemetry.depth[i].depth = 1.0 + 0.5 * sin(0.2 * ts);
+        telemetry.depth[i].pressure = 1013.25 + 98.1 * telemetry.depth[i].depth;
+        telemetry.depth[i].temp = 20.0;
+      }
+      uint8_t frame[COPRO_MAX_FRAME];
+      size_t len = encodeTelemetryFrame(seq, telemetry, frame);
+      if (corrupt > 0 && seq % corrupt == 0)
+        frame[len - 1] ^= 0xFF;
+      seq++;
+      writeAll(master, frame, len);
+      next_frame += 1.0 / rate;
+    }
+
+    if (t >= next_report)
+    {
+      printf("%lu PWM frames (%lu CRC errors, %lu lost)", parser.frames, parser.crc_errors, parser.lost);
+      if (!received.empty())
+      {
+        uint16_t pwm[COPRO_PWM_CHANNELS];
+        decodePwm(&received.back()[2], pwm);
+        printf(", last:");
+        for (int i = 0; i < COPRO_PWM_CHANNELS; i++)
+          printf(" %d", pwm[i]);
+      }
+      printf("\n");
+      fflush(stdout);
+      received.clear();
+      next_report += 1;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0)
+    return selftest(argc > 2 ? atoi(argv[2]) : 1000);
+
+  double rate = argc > 1 ? atof(argv[1]) : 50;
+  int corrupt = argc > 2 ? atoi(argv[2]) : 0;
+  if (rate <= 0)
+  {
+    fprintf(stderr, "rate must be positive\n");
+    return 1;
+  }
+  return emulate(rate, corrupt);
+}
@@ -0,0 +1,140 @@
+#include "riptide_hardware/depth_estimator.h"
+
+#include <math.h>
+
+DepthSpikeFilter::DepthSpikeFilter() : window(1), count(0), pos(0), threshold(0)
+{
+}
+
+void DepthSpikeFilter::configure(int median_window, double spike_threshold)
+{
+  window = median_window < 1 ? 1 : median_window > DEPTH_MEDIAN_MAX_WINDOW ? DEPTH_MEDIAN_MAX_WINDOW : median_window;
+  if (window % 2 == 0)
+    window--;
+  threshold = spike_threshold;
+  reset();
+}
+
+double DepthSpikeFilter::apply(double x, bool &rejected)
+{
+  rejected = false;
+  samples[pos] = x;
+  pos = (pos + 1) % window;
+  if (count < window)
+    count++;
+  if (count < window || window == 1)
+    return x;
+
+  // Insertion sort of a copy: at most 9 samples, so cheaper than anything cleverer
+  double sorted[DEPTH_MEDIAN_MAX_WINDOW];
+  for (int i = 0; i < window; i++)
+  {
+    double v = samples[i];
+    int j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  double median = sorted[window / 2];
+
+  if (fabs(x - median) > threshold)
+  {
+    rejected = true;
+    return median;
+  }
+  return x;
+}
+
+DepthEstimator::DepthEstimator() : initialized(false)
+{
+  configure(0.02, 0.5, 0.2, 0.01, 0.5);
+  for (int i = 0; i < 3; i++)
+  {
+    x[i] = 0;
+    for (int j = 0; j < 3; j++)
+      P[i][j] = 0;
+  }
+}
+
+void DepthEstimator::configure(double depth_sigma, double model_accel_sigma, double imu_accel_sigma,
+                               double imu_bias_sigma, double imu_bias_initial)
+{
+  depth_var = depth_sigma * depth_sigma;
+  model_var = model_accel_sigma * model_accel_sigma;
+  accel_var = imu_accel_sigma * imu_accel_sigma;
+  bias_var = imu_bias_sigma * imu_bias_sigma;
+  bias_var0 = imu_bias_initial * imu_bias_initial;
+}
+
+// P = F P F' + Q, where F = [1 dt -k*dt^2/2; 0 1 -k*dt; 0 0 1] and the white
+// acceleration noise q enters depth and velocity through [dt^2/2; dt]
+void DepthEstimator::propagate(double dt, double q, double bias_q, double k)
+{
+  const double F[3][3] = { { 1, dt, -k * dt * dt / 2 }, { 0, 1, -k * dt }, { 0, 0, 1 } };
+  double FP[3][3];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      FP[i][j] = F[i][0] * P[0][j] + F[i][1] * P[1][j] + F[i][2] * P[2][j];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      P[i][j] = FP[i][0] * F[j][0] + FP[i][1] * F[j][1] + FP[i][2] * F[j][2];
+
+  double g0 = dt * dt / 2, g1 = dt;
+  P[0][0] += q * g0 * g0;
+  P[0][1] += q * g0 * g1;
+  P[1][0] += q * g0 * g1;
+  P[1][1] += q * g1 * g1;
+  P[2][2] += bias_q * dt;
+}
+
+void DepthEstimator::predict(double dt)
+{
+  if (!initialized || dt <= 0)
+    return;
+  x[0] += x[1] * dt;
+  propagate(dt, model_var, 0, 0);
+}
+
+void DepthEstimator::predict(double dt, double accel)
+{
+  if (!initialized || dt <= 0)
+    return;
+  double a = accel - x[2];
+  x[0] += x[1] * dt + a * dt * dt / 2;
+  x[1] += a * dt;
+  propagate(dt, accel_var, bias_var, 1);
+}
+
+void DepthEstimator::update(double depth)
+{
+  if (!initialized)
+  {
+    x[0] = depth;
+    x[1] = 0;
+    x[2] = 0;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        P[i][j] = 0;
+    P[0][0] = depth_var;
+    P[1][1] = 0.25; // At rest to within about 0.5 m/s
+    P[2][2] = bias_var0;
+    initialized = true;
+    return;
+  }
+
+  // H = [1 0 0], so the gain is the first column of P over the innovation variance
+  double y = depth - x[0];
+  double s = P[0][0] + depth_var;
+  double K[3] = { P[0][0] / s, P[1][0] / s, P[2][0] / s };
+  for (int i = 0; i < 3; i++)
+    x[i] += K[i] * y;
+
+  double P0[3] = { P[0][0], P[0][1], P[0][2] };
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      P[i][j] -= K[i] * P0[j];
+  // Keep P symmetric against rounding
+  for (int i = 0; i < 3; i++)
+    for (int j = i + 1; j < 3; j++)
+      P[i][j] = P[j][i] = (P[i][j] + P[j][i]) / 2;
+}
@@ -1,27 +1,99 @@
 #include "riptide_hardware/depth_processor.h"
+#include <math.h>
 
-int main(int argc, char** argv)
+//Constructor
+//Estimator parameters, from cfg/depth_processor.yaml:
+//  median_window, spike_threshold: median-of-N spike rejection [samples, m]
+//  depth_sigma: depth sensor noise [m]
+//  accel_sigma: unmodelled vertical acceleration when not using the IMU [m/s^2]
+//  use_imu: drive the prediction with state/imu vertical acceleration
+//  imu_accel_sigma, imu_bias_sigma, imu_bias_initial: IMU acceleration noise [m/s^2],
+//    bias walk [m/s^2/sqrt(s)] and initial bias uncertainty [m/s^2]
+//  imu_gravity: vertical acceleration the IMU reports at rest, 0 if it removes gravity [m/s^2]
+DepthProcessor::DepthProcessor() : DepthProcessor(ros::NodeHandle())
 {
- ros::init(argc, argv, "depth_processor");
- DepthProcessor depth_processor;
- ros::spin();
 }
 
-//Constructor
-DepthProcessor::DepthProcessor() : nh()
+//node is the nodelet's handle when run as a nodelet
+DepthProcessor::DepthProcessor(const ros::NodeHandle &node) : nh(node), spikes(0), imu_accel(0)
 {
+ ros::NodeHandle dpp(nh, "depth_processor");
+ int median_window;
+ double spike_threshold, depth_sigma, accel_sigma, imu_accel_sigma, imu_bias_sigma, imu_bias_initial;
+ dpp.param("median_window", median_window, 5);
+ dpp.param("spike_threshold", spike_threshold, 0.3);
+ dpp.param("depth_sigma", depth_sigma, 0.02);
+ dpp.param("accel_sigma", accel_sigma, 0.5);
+ dpp.param("use_imu", use_imu, false);
+ dpp.param("imu_accel_sigma", imu_accel_sigma, 0.2);
+ dpp.param("imu_bias_sigma", imu_bias_sigma, 0.01);
+ dpp.param("imu_bias_initial", imu_bias_initial, 0.5);
+ dpp.param("imu_gravity", imu_gravity, 0.0);
+ spike_filter.configure(median_window, spike_threshold);
+ estimator.configure(depth_sigma, accel_sigma, imu_accel_sigma, imu_bias_sigma, imu_bias_initial);
+
  depth_sub = nh.subscribe<riptide_msgs::Depth>("arduino/depth", 1, &DepthProcessor::DepthCB, this);
- state_depth_pub = nh.advertise<riptide_msgs::Depth>("state/depth", 1);
+ if (use_imu)
+   imu_sub = nh.subscribe<riptide_msgs::Imu>("state/imu", 1, &DepthProcessor::ImuCB, this);
+ state_depth_pub = nh.advertise<riptide_msgs::DepthState>("state/depth", 1);
+ ROS_INFO("Depth Processor: median of %d, %s", spike_filter.getWindow(), use_imu ? "fusing IMU" : "no IMU");
+}
+
+//Vertical acceleration in the world frame, from the body frame (x forward,
+//y left, z up) through roll and pitch
+void DepthProcessor::ImuCB(const riptide_msgs::Imu::ConstPtr& imu)
+{
+  double roll = imu->euler_rpy.x * M_PI / 180, pitch = imu->euler_rpy.y * M_PI / 180;
+  const geometry_msgs::Vector3 &a = imu->linear_accel;
+  double up = -sin(pitch) * a.x + cos(pitch) * sin(roll) * a.y + cos(pitch) * cos(roll) * a.z;
+  imu_accel = imu_gravity - up;
+  imu_stamp = imu->header.stamp.isZero() ? ros::Time::now() : imu->header.stamp;
 }
 
 //Callback
 void DepthProcessor::DepthCB(const riptide_msgs::Depth::ConstPtr& depth)
 {
-    riptide_msgs::Depth corrected;
-    corrected.depth = (DEPTH_SLOPE * depth->depth) + DEPTH_OFFSET;
-    // Eliminate the spikes
-    if (corrected.depth > 10 || corrected.depth < -10)
-      corrected = lastDepth;
+    ros::Time stamp = depth->header.stamp.isZero() ? ros::Time::now() : depth->header.stamp;
+    double dt = (stamp - last_stamp).toSec();
+    if (last_stamp.isZero() || dt > DEPTH_MAX_GAP || dt < 0)
+    {
+      estimator.reset();
+      spike_filter.reset();
+    }
+    last_stamp = stamp;
+
+    if (use_imu && fabs((stamp - imu_stamp).toSec()) < IMU_MAX_AGE)
+      estimator.predict(dt, imu_accel);
+    else
+      estimator.predict(dt);
+
+    // Out of range readings are dropped, the rest go through the spike filter
+    double measured = (DEPTH_SLOPE * depth->depth) + DEPTH_OFFSET;
+    if (measured <= 10 && measured >= -10)
+    {
+      bool rejected;
+      double sample = spike_filter.apply(measured, rejected);
+      if (rejected)
+      {
+        spikes++;
+        ROS_WARN_THROTTLE(5, "Depth Processor: %.2f m is a spike, %lu rejected", measured, spikes);
+      }
+      // Starting the estimator on a spike would take seconds to recover from
+      if (spike_filter.isFull())
+        estimator.update(sample);
+    }
+    if (!estimator.isInitialized())
+      return;
+
+    // The source's header goes through, so consumers can measure latency from
+    // the sample time. The message comes from the pool and reaches in-process
+    // subscribers without a copy.
+    boost::shared_ptr<riptide_msgs::DepthState> corrected = pool.get();
+    corrected->header = depth->header;
+    corrected->header.stamp = stamp;
+    corrected->depth = estimator.getDepth();
+    corrected->velocity = estimator.getVelocity();
+    corrected->pressure = depth->pressure;
+    corrected->temp = depth->temp;
     state_depth_pub.publish(corrected);
-    lastDepth = corrected;
 }
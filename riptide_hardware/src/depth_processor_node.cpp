@@ -0,0 +1,8 @@
+#include "riptide_hardware/depth_processor.h"
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "depth_processor");
+  DepthProcessor depth_processor;
+  ros::spin();
+}
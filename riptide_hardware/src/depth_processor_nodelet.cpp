@@ -0,0 +1,20 @@
+// depth_processor as a nodelet. Loaded into the same manager as
+// depth_controller and thruster_controller, state/depth reaches them as the
+// published pointer, with no serialization or copy.
+
+#include "riptide_hardware/depth_processor.h"
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+class DepthProcessorNodelet : public nodelet::Nodelet
+{
+private:
+  boost::shared_ptr<DepthProcessor> processor;
+
+  void onInit()
+  {
+    processor.reset(new DepthProcessor(getNodeHandle()));
+  }
+};
+
+PLUGINLIB_EXPORT_CLASS(DepthProcessorNodelet, nodelet::Nodelet)
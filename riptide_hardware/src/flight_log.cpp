@@ -0,0 +1,261 @@
+#include "riptide_hardware/flight_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FLIGHT_LOG_MAGIC "RIPTREC"
+
+static uint32_t padded(uint32_t length)
+{
+  return (length + 7) & ~7u;
+}
+
+void ChunkBuilder::start(uint8_t *chunk, uint32_t chunk_size, uint32_t sequence)
+{
+  base = chunk;
+  size = chunk_size;
+  ChunkHeader *h = reinterpret_cast<ChunkHeader *>(base);
+  memset(h, 0, sizeof(*h));
+  h->magic = CHUNK_MAGIC;
+  h->sequence = sequence;
+}
+
+uint8_t *ChunkBuilder::reserve(uint64_t stamp, uint16_t topic, uint16_t kind, uint32_t length)
+{
+  ChunkHeader *h = reinterpret_cast<ChunkHeader *>(base);
+  uint64_t needed = sizeof(RecordHeader) + padded(length);
+  if (sizeof(ChunkHeader) + h->used + needed > size)
+    return 0;
+
+  RecordHeader *r = reinterpret_cast<RecordHeader *>(base + sizeof(ChunkHeader) + h->used);
+  r->stamp = stamp;
+  r->topic = topic;
+  r->kind = kind;
+  r->length = length;
+
+  if (h->records == 0)
+    h->start = stamp;
+  h->end = stamp;
+  h->records++;
+  h->used += needed;
+  return reinterpret_cast<uint8_t *>(r + 1);
+}
+
+uint32_t ChunkBuilder::capacity(uint32_t chunk_size)
+{
+  return chunk_size - sizeof(ChunkHeader) - sizeof(RecordHeader);
+}
+
+bool addTopicRecord(ChunkBuilder &chunk, uint64_t stamp, uint16_t topic, const FlightLogTopic &info)
+{
+  const std::string *fields[4] = { &info.name, &info.datatype, &info.md5sum, &info.definition };
+  uint32_t length = 0;
+  for (int i = 0; i < 4; i++)
+    length += fields[i]->size() + 1;
+
+  uint8_t *p = chunk.reserve(stamp, topic, RECORD_TOPIC, length);
+  if (!p)
+    return false;
+  for (int i = 0; i < 4; i++)
+  {
+    memcpy(p, fields[i]->c_str(), fields[i]->size() + 1);
+    p += fields[i]->size() + 1;
+  }
+  return true;
+}
+
+FlightLogWriter::FlightLogWriter() : fd(-1), map(0), map_size(0), chunk_size(0), chunks(0), used_chunks(0)
+{
+}
+
+bool FlightLogWriter::open(const std::string &path, uint32_t chunk_size, uint32_t chunks, uint64_t created)
+{
+  close();
+  this->chunk_size = chunk_size;
+  this->chunks = chunks;
+  used_chunks = 0;
+  map_size = sizeof(FlightLogHeader) + static_cast<size_t>(chunk_size) * chunks;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return false;
+  // Allocating the blocks now keeps page faults on the mapping from waiting on the filesystem
+  if (posix_fallocate(fd, 0, map_size) != 0 && ftruncate(fd, map_size) != 0)
+  {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  void *p = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+  {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  map = static_cast<uint8_t *>(p);
+
+  FlightLogHeader *h = reinterpret_cast<FlightLogHeader *>(map);
+  memset(h, 0, sizeof(*h));
+  strncpy(h->magic, FLIGHT_LOG_MAGIC, sizeof(h->magic));
+  h->version = FLIGHT_LOG_VERSION;
+  h->chunk_size = chunk_size;
+  h->created = created;
+  return true;
+}
+
+void FlightLogWriter::close()
+{
+  if (!map)
+    return;
+  munmap(map, map_size);
+  map = 0;
+  // On failure the unused chunks stay zero, which readers take as the end of the log
+  if (ftruncate(fd, sizeof(FlightLogHeader) + static_cast<size_t>(chunk_size) * used_chunks) != 0)
+    fprintf(stderr, "FlightLogWriter: cannot trim log: %s\n", strerror(errno));
+  ::close(fd);
+  fd = -1;
+}
+
+uint8_t *FlightLogWriter::nextChunk()
+{
+  if (!map || used_chunks >= chunks)
+    return 0;
+  return map + sizeof(FlightLogHeader) + static_cast<size_t>(chunk_size) * used_chunks++;
+}
+
+FlightLogReader::FlightLogReader() : fd(-1), map(0), map_size(0), chunk(0), offset(0)
+{
+}
+
+bool FlightLogReader::open(const std::string &path, std::string &error)
+{
+  close();
+  fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+  map_size = st.st_size;
+  if (map_size < sizeof(FlightLogHeader))
+  {
+    error = path + ": too short for a flight log";
+    return false;
+  }
+  void *p = mmap(0, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+  {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+  map = static_cast<const uint8_t *>(p);
+
+  memcpy(&file_header, map, sizeof(file_header));
+  if (strncmp(file_header.magic, FLIGHT_LOG_MAGIC, sizeof(file_header.magic)) != 0 ||
+      file_header.version != FLIGHT_LOG_VERSION || file_header.chunk_size <= sizeof(ChunkHeader))
+  {
+    error = path + ": not a version " + std::to_string(FLIGHT_LOG_VERSION) + " flight log";
+    return false;
+  }
+
+  index.clear();
+  for (size_t at = sizeof(FlightLogHeader); at + file_header.chunk_size <= map_size; at += file_header.chunk_size)
+  {
+    const ChunkHeader *h = reinterpret_cast<const ChunkHeader *>(map + at);
+    if (h->magic != CHUNK_MAGIC || sizeof(ChunkHeader) + h->used > file_header.chunk_size)
+      break;
+    index.push_back(h);
+  }
+  topic_info.clear();
+  chunk = 0;
+  offset = 0;
+  return true;
+}
+
+void FlightLogReader::close()
+{
+  if (map)
+    munmap(const_cast<uint8_t *>(map), map_size);
+  if (fd >= 0)
+    ::close(fd);
+  map = 0;
+  fd = -1;
+  index.clear();
+}
+
+void FlightLogReader::seek(uint64_t stamp)
+{
+  // Bisect for the first chunk that ends at or after stamp
+  size_t lo = 0, hi = index.size();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (index[mid]->end < stamp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // Read the skipped chunks' topic records
+  chunk = 0;
+  offset = 0;
+  Record r;
+  while (chunk < lo && next(r))
+    ;
+  chunk = lo;
+  offset = 0;
+}
+
+bool FlightLogReader::next(Record &record)
+{
+  while (chunk < index.size())
+  {
+    const ChunkHeader *h = index[chunk];
+    if (offset >= h->used)
+    {
+      chunk++;
+      offset = 0;
+      continue;
+    }
+
+    const uint8_t *body = reinterpret_cast<const uint8_t *>(h + 1);
+    const RecordHeader *r = reinterpret_cast<const RecordHeader *>(body + offset);
+    offset += sizeof(RecordHeader) + padded(r->length);
+    if (offset > h->used)
+      break; // Corrupt chunk
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(r + 1);
+    if (r->kind == RECORD_TOPIC)
+    {
+      // Four nul-terminated strings
+      FlightLogTopic info;
+      std::string *fields[4] = { &info.name, &info.datatype, &info.md5sum, &info.definition };
+      const char *p = reinterpret_cast<const char *>(data);
+      const char *end = p + r->length;
+      for (int i = 0; i < 4 && p < end; i++)
+      {
+        size_t n = strnlen(p, end - p);
+        fields[i]->assign(p, n);
+        p += n + 1;
+      }
+      topic_info[r->topic] = info;
+    }
+    else if (r->kind == RECORD_MESSAGE)
+    {
+      record.stamp = r->stamp;
+      record.topic = r->topic;
+      record.data = data;
+      record.length = r->length;
+      return true;
+    }
+  }
+  chunk = index.size();
+  return false;
+}
@@ -0,0 +1,82 @@
+// Lists a flight log written by flight_recorder. Runs without ROS.
+//
+// Usage: flight_log_info [--chunks] log.rec
+//
+// Prints the log's time range and, for each topic, its type, message count and
+// bytes. --chunks also prints the chunk index.
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+#include "riptide_hardware/flight_log.h"
+
+struct TopicStats
+{
+  uint64_t messages, bytes;
+  TopicStats() : messages(0), bytes(0) {}
+};
+
+int main(int argc, char **argv)
+{
+  bool chunks = false;
+  const char *path = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--chunks") == 0)
+      chunks = true;
+    else
+      path = argv[i];
+  }
+  if (!path)
+  {
+    fprintf(stderr, "usage: %s [--chunks] log.rec\n", argv[0]);
+    return 2;
+  }
+
+  FlightLogReader reader;
+  std::string error;
+  if (!reader.open(path, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  printf("%s: %zu chunks of %u kB\n", path, reader.numChunks(), reader.header().chunk_size >> 10);
+  if (reader.numChunks() == 0)
+    return 0;
+  uint64_t start = reader.chunkHeader(0).start;
+  uint64_t end = reader.chunkHeader(reader.numChunks() - 1).end;
+  printf("duration: %.3f s\n", 1e-9 * (end - start));
+
+  if (chunks)
+  {
+    printf("\n%8s %10s %10s %8s %6s\n", "sequence", "start [s]", "end [s]", "records", "used");
+    for (size_t i = 0; i < reader.numChunks(); i++)
+    {
+      const ChunkHeader &h = reader.chunkHeader(i);
+      printf("%8u %10.3f %10.3f %8u %5.1f%%\n", h.sequence, 1e-9 * (h.start - start), 1e-9 * (h.end - start),
+             h.records, 100.0 * h.used / (reader.header().chunk_size - sizeof(ChunkHeader)));
+    }
+  }
+
+  std::map<uint16_t, TopicStats> stats;
+  FlightLogReader::Record record;
+  while (reader.next(record))
+  {
+    stats[record.topic].messages++;
+    stats[record.topic].bytes += record.length;
+  }
+
+  printf("\n");
+  for (std::map<uint16_t, TopicStats>::iterator it = stats.begin(); it != stats.end(); ++it)
+  {
+    std::map<uint16_t, FlightLogTopic>::const_iterator info = reader.topics().find(it->first);
+    const char *name = info != reader.topics().end() ? info->second.name.c_str() : "(undefined)";
+    const char *type = info != reader.topics().end() ? info->second.datatype.c_str() : "";
+    printf("%-24s %-28s %10lu msgs %10.1f kB\n", name, type, static_cast<unsigned long>(it->second.messages),
+           it->second.bytes / 1024.0);
+  }
+  return 0;
+}
@@ -0,0 +1,267 @@
+// Records any set of topics to a chunked, memory-mapped flight log
+// (flight_log.h); flight_log_info lists a log's contents.
+//
+// In continuous mode everything goes to <prefix>_<n>.rec files. In triggered
+// mode messages go round a ring in memory holding the last pretrigger_mb, and
+// when the kill switch is pulled the ring, then the next post_trigger_s seconds,
+// are written out.
+
+#include "riptide_hardware/flight_recorder.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "flight_recorder");
+  FlightRecorder fr;
+  fr.loop();
+}
+
+FlightRecorder::FlightRecorder() : nh(), file_number(0), sequence(0), ring_head(0), ring_count(0), last_kill(false),
+                                   messages(0), dropped(0), bytes(0)
+{
+  std::vector<std::string> names;
+  std::vector<std::string> default_names;
+  // Sensor inputs and commands into the control stack, so control_replay can
+  // rerun it, and what the stack produced
+  default_names.push_back("/imu/filter");
+  default_names.push_back("/imu/magnetic_field");
+  default_names.push_back("/arduino/depth");
+  default_names.push_back("/state/imu");
+  default_names.push_back("/state/imu_verbose");
+  default_names.push_back("/state/depth");
+  default_names.push_back("/state/switches");
+  default_names.push_back("/command/depth");
+  default_names.push_back("/command/attitude");
+  default_names.push_back("/command/accel/linear/x");
+  default_names.push_back("/command/accel/linear/y");
+  default_names.push_back("/command/thruster_mask");
+  default_names.push_back("/command/thrust");
+  default_names.push_back("/command/pwm");
+  nh.param("flight_recorder/topics", names, default_names);
+
+  const char *home = getenv("HOME");
+  std::string mode;
+  int chunk_kb, file_size_mb, pretrigger_mb;
+  nh.param<std::string>("flight_recorder/file_prefix", prefix,
+                        std::string(home ? home : ".") + "/osu-uwrt/flight"); //File path included in prefix
+  nh.param<std::string>("flight_recorder/mode", mode, "triggered"); //"continuous" or "triggered"
+  nh.param("flight_recorder/chunk_kb", chunk_kb, 1024); //Unit of indexing and of the pre-trigger ring
+  nh.param("flight_recorder/file_size_mb", file_size_mb, 256); //Files rotate at this size
+  nh.param("flight_recorder/pretrigger_mb", pretrigger_mb, 32); //Memory kept before a trigger
+  nh.param("flight_recorder/post_trigger_s", post_trigger, 30.0); //Recording after the last trigger
+
+  continuous = mode == "continuous";
+  if (!continuous && mode != "triggered")
+    ROS_WARN("Flight Recorder: unknown mode \"%s\", using triggered", mode.c_str());
+  chunk_size = std::max(chunk_kb, 64) << 10;
+  ring_chunks = std::max(1, (pretrigger_mb << 20) / static_cast<int>(chunk_size));
+  // A file must hold at least the whole ring
+  file_chunks = std::max(static_cast<uint32_t>((static_cast<uint64_t>(file_size_mb) << 20) / chunk_size),
+                         ring_chunks + 1);
+  if (!continuous)
+    ring.resize(static_cast<size_t>(ring_chunks) * chunk_size);
+
+  topics.resize(names.size());
+  topic_known.assign(names.size(), false);
+  topic_written.assign(names.size(), false);
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    topics[i].name = names[i];
+    boost::function<void(const ros::MessageEvent<topic_tools::ShapeShifter const> &)> cb =
+        boost::bind(&FlightRecorder::messageCB, this, _1, static_cast<uint16_t>(i));
+    subs.push_back(nh.subscribe<topic_tools::ShapeShifter>(names[i], 100, cb, ros::VoidConstPtr(),
+                                                           ros::TransportHints().tcpNoDelay()));
+  }
+  switch_sub = nh.subscribe<riptide_msgs::SwitchState>("/state/switches", 10, &FlightRecorder::switchCB, this);
+  diag_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  status_timer = nh.createTimer(ros::Duration(1.0), &FlightRecorder::statusCB, this);
+
+  ROS_INFO("Flight Recorder: %s, %zu topics to %s_<n>.rec", continuous ? "continuous" : "triggered",
+           names.size(), prefix.c_str());
+}
+
+// Opens the first unused <prefix>_<n>.rec at or after file_number
+bool FlightRecorder::openFile()
+{
+  std::string name;
+  uint64_t created = ros::WallTime::now().toNSec();
+  for (;; file_number++)
+  {
+    name = prefix + "_" + std::to_string(file_number) + ".rec";
+    if (writer.open(name, chunk_size, file_chunks, created) || errno != EEXIST)
+      break;
+  }
+  if (!writer.isOpen())
+  {
+    ROS_ERROR_THROTTLE(5, "Flight Recorder: cannot create %s: %s", name.c_str(), strerror(errno));
+    return false;
+  }
+  file_number++;
+  topic_written.assign(topics.size(), false);
+  ROS_INFO("Flight Recorder: recording to %s", name.c_str());
+  return true;
+}
+
+void FlightRecorder::closeFile()
+{
+  chunk.finish();
+  writer.close();
+}
+
+// Starts the next chunk: in the file when recording, otherwise the next ring slot
+bool FlightRecorder::nextChunk()
+{
+  chunk.finish();
+  uint8_t *memory;
+  if (continuous || writer.isOpen())
+  {
+    memory = writer.isOpen() ? writer.nextChunk() : 0;
+    if (!memory)
+    {
+      // File full
+      writer.close();
+      if (!openFile())
+        return false;
+      memory = writer.nextChunk();
+    }
+  }
+  else
+  {
+    memory = &ring[static_cast<size_t>(ring_head) * chunk_size];
+    ring_head = (ring_head + 1) % ring_chunks;
+    ring_count = std::min(ring_count + 1, ring_chunks);
+    // Each ring chunk describes its own topics, since the oldest are overwritten
+    topic_written.assign(topics.size(), false);
+  }
+  chunk.start(memory, chunk_size, sequence++);
+  return true;
+}
+
+// Space for a message, preceded by its topic record if the file does not have
+// one yet; 0 if the message cannot be stored
+uint8_t *FlightRecorder::reserve(uint64_t stamp, uint16_t topic, uint32_t length)
+{
+  if (length > ChunkBuilder::capacity(chunk_size))
+    return 0;
+
+  // The second try is in an empty chunk, where the message always fits unless
+  // its topic record is huge
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    if (!chunk.active() && !nextChunk())
+      return 0;
+    if (!topic_written[topic])
+      topic_written[topic] = addTopicRecord(chunk, stamp, topic, topics[topic]);
+    if (topic_written[topic])
+    {
+      uint8_t *p = chunk.reserve(stamp, topic, RECORD_MESSAGE, length);
+      if (p)
+        return p;
+    }
+    chunk.finish();
+  }
+  return 0;
+}
+
+// Serializes the message straight into the log: the subscription's receive
+// buffer is copied once, into the mapped file or the ring
+void FlightRecorder::messageCB(const ros::MessageEvent<topic_tools::ShapeShifter const> &event, uint16_t topic)
+{
+  const topic_tools::ShapeShifter &msg = *event.getConstMessage();
+  if (!topic_known[topic])
+  {
+    topics[topic].datatype = msg.getDataType();
+    topics[topic].md5sum = msg.getMD5Sum();
+    topics[topic].definition = msg.getMessageDefinition();
+    topic_known[topic] = true;
+  }
+
+  uint32_t length = msg.size();
+  uint8_t *p = reserve(event.getReceiptTime().toNSec(), topic, length);
+  if (!p)
+  {
+    dropped++;
+    ROS_WARN_THROTTLE(5, "Flight Recorder: cannot record %s, %" PRIu64 " messages dropped", topics[topic].name.c_str(),
+                      dropped);
+    return;
+  }
+  ros::serialization::OStream stream(p, length);
+  msg.write(stream);
+  messages++;
+  bytes += length;
+}
+
+// Writes out the ring, oldest chunk first, and records from then on. Runs on
+// the callback thread, so other callbacks wait for the copy.
+void FlightRecorder::trigger()
+{
+  stop_time = ros::Time::now() + ros::Duration(post_trigger);
+  if (continuous || writer.isOpen())
+    return;
+  if (!openFile())
+    return;
+
+  uint32_t oldest = (ring_head + ring_chunks - ring_count) % ring_chunks;
+  for (uint32_t i = 0; i < ring_count; i++)
+  {
+    uint8_t *memory = writer.nextChunk();
+    memcpy(memory, &ring[static_cast<size_t>((oldest + i) % ring_chunks) * chunk_size], chunk_size);
+  }
+  ROS_INFO("Flight Recorder: triggered, %u MB from before the trigger written", (ring_count * chunk_size) >> 20);
+
+  // The ring's partly filled chunk is in the file now, so start a new one there
+  chunk.finish();
+  ring_count = 0;
+}
+
+// The kill switch coming out is the trigger
+void FlightRecorder::switchCB(const riptide_msgs::SwitchState::ConstPtr &state)
+{
+  if (last_kill && !state->kill)
+    trigger();
+  last_kill = state->kill;
+}
+
+void FlightRecorder::statusCB(const ros::TimerEvent &event)
+{
+  if (!continuous && writer.isOpen() && event.current_real > stop_time)
+  {
+    closeFile();
+    ROS_INFO("Flight Recorder: recording stopped, back to the pre-trigger ring");
+  }
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = "flight_recorder";
+  status.hardware_id = "flight_recorder";
+  status.level = dropped ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = writer.isOpen() ? "recording" : "pre-trigger";
+
+  std::vector<std::pair<std::string, std::string> > values;
+  values.push_back(std::make_pair("messages", std::to_string(messages)));
+  values.push_back(std::make_pair("dropped", std::to_string(dropped)));
+  values.push_back(std::make_pair("data [MB]", std::to_string(bytes / 1048576.0)));
+  values.push_back(std::make_pair("chunks", std::to_string(sequence)));
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = values[i].first;
+    kv.value = values[i].second;
+    status.values.push_back(kv);
+  }
+
+  diagnostic_msgs::DiagnosticArray diag;
+  diag.header.stamp = ros::Time::now();
+  diag.status.push_back(status);
+  diag_pub.publish(diag);
+}
+
+void FlightRecorder::loop()
+{
+  ros::spin();
+  closeFile();
+}
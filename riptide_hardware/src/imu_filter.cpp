@@ -0,0 +1,123 @@
+#include "riptide_hardware/imu_filter.h"
+
+#include <math.h>
+#include <sstream>
+
+ImuFilter::ImuFilter() : num_taps(0), pos(0), b0(0), b1(0), b2(0), a1(0), a2(0)
+{
+  setNone();
+}
+
+void ImuFilter::setNone()
+{
+  type = NONE;
+  delay = 0;
+  primed = false;
+}
+
+std::string ImuFilter::setFir(const std::vector<double> &fir_taps)
+{
+  std::ostringstream error;
+  if (fir_taps.empty() || fir_taps.size() > IMU_FILTER_MAX_TAPS)
+  {
+    error << "FIR filter needs 1 to " << IMU_FILTER_MAX_TAPS << " taps, got " << fir_taps.size();
+    return error.str();
+  }
+  double sum = 0, moment = 0;
+  for (size_t k = 0; k < fir_taps.size(); k++)
+  {
+    sum += fir_taps[k];
+    moment += k * fir_taps[k];
+  }
+  if (fabs(sum) < 1e-9)
+    return "FIR taps sum to zero, so they cannot be normalized";
+
+  type = FIR;
+  num_taps = fir_taps.size();
+  for (int k = 0; k < num_taps; k++)
+    taps[k] = fir_taps[k] / sum;
+  delay = static_cast<int>(moment / sum + 0.5);
+  delay = delay < 0 ? 0 : delay >= num_taps ? num_taps - 1 : delay;
+  pos = 0;
+  primed = false;
+  return "";
+}
+
+// Bilinear transform with the cutoff prewarped
+std::string ImuFilter::setButterworth(double cutoff, double sample_rate)
+{
+  std::ostringstream error;
+  if (cutoff <= 0 || sample_rate <= 0 || cutoff >= sample_rate / 2)
+  {
+    error << "Butterworth cutoff " << cutoff << " Hz must be between 0 and half the " << sample_rate
+          << " Hz sample rate";
+    return error.str();
+  }
+
+  double k = tan(M_PI * cutoff / sample_rate);
+  double norm = 1 / (1 + M_SQRT2 * k + k * k);
+  type = IIR;
+  b0 = k * k * norm;
+  b1 = 2 * b0;
+  b2 = b0;
+  a1 = 2 * (k * k - 1) * norm;
+  a2 = (1 - M_SQRT2 * k + k * k) * norm;
+  delay = 0;
+  primed = false;
+  return "";
+}
+
+// Steady state for a constant input x, so the output starts at the first sample
+void ImuFilter::prime(const double x[LANES])
+{
+  for (int k = 0; k < IMU_FILTER_MAX_TAPS; k++)
+    for (int ch = 0; ch < LANES; ch++)
+      line[k][ch] = x[ch];
+  for (int ch = 0; ch < LANES; ch++)
+  {
+    z2[ch] = (b2 - a2) * x[ch];
+    z1[ch] = (b1 - a1) * x[ch] + z2[ch];
+  }
+  primed = true;
+}
+
+void ImuFilter::apply(double x[IMU_CHANNELS])
+{
+  if (type == NONE)
+    return;
+
+  alignas(32) double in[LANES] = { 0 };
+  alignas(32) double out[LANES] = { 0 };
+  for (int ch = 0; ch < IMU_CHANNELS; ch++)
+    in[ch] = x[ch];
+  if (!primed)
+    prime(in);
+
+  if (type == FIR)
+  {
+    pos = pos + 1 < num_taps ? pos + 1 : 0;
+    for (int ch = 0; ch < LANES; ch++)
+      line[pos][ch] = in[ch];
+
+    // taps[0] applies to the newest input
+    int row = pos;
+    for (int k = 0; k < num_taps; k++)
+    {
+      for (int ch = 0; ch < LANES; ch++)
+        out[ch] += taps[k] * line[row][ch];
+      row = row > 0 ? row - 1 : num_taps - 1;
+    }
+  }
+  else
+  {
+    for (int ch = 0; ch < LANES; ch++)
+    {
+      out[ch] = b0 * in[ch] + z1[ch];
+      z1[ch] = b1 * in[ch] - a1 * out[ch] + z2[ch];
+      z2[ch] = b2 * in[ch] - a2 * out[ch];
+    }
+  }
+
+  for (int ch = 0; ch < IMU_CHANNELS; ch++)
+    x[ch] = out[ch];
+}
@@ -24,7 +24,8 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
  *********************************************************************************/
-//YOU MUST CHANGE THE "file_prefix" BEFORE USING
+//Magnetometer samples go to the binary log (scripts/log_to_csv.py converts it)
+//Set imu_logger/file_prefix before using, or the log goes to ~/osu-uwrt/imu_mag_components_<n>.bin
 
 
 #include "riptide_hardware/imu_logger.h"
@@ -34,84 +35,46 @@ int main(int argc, char** argv)
   ros::init(argc, argv, "imu_logger");
   IMULogger imu_logger(argv);
   imu_logger.loop();
-  ROS_INFO("IMU logger looping");
 }
 
-//Converts std::string to char*
-char* IMULogger::convert(const std::string& str) {
-   char* result = new char[str.length()+1];
-   strcpy(result,str.c_str());
-   return result;
- }
-
 //Constructor
- IMULogger::IMULogger(char **argv) : nh()
+ IMULogger::IMULogger(char **argv) : nh(), monitor(nh, "imu_logger")
  {
    mag_sub = nh.subscribe<imu_3dm_gx4::MagFieldCF>("imu/magnetic_field", 1, &IMULogger::magLogger, this);
-   initialized = false;
-   tStart = 0, tNow = 0;
-
-   //Create a new file for logging IMU data
-   bool found_new_file_name = false;
-   int num = 1; //Begin file counting here
-   std::string file_suffix = boost::lexical_cast<std::string>(num); //Convert int to string
-   std::string file_prefix = "//home//tsender//osu-uwrt//imu_mag_components"; //File path included in prefix
-   std::string file_type = ".csv";
 
-   //Create file name
-   char *file_name = strcat(convert(file_prefix),convert(file_suffix)); //Combine prefix and suffix
-   file_name = strcat(file_name,convert(file_type)); //Append file type
-   file_name_c = file_name; //Convert to const char*
+   const char *home = getenv("HOME");
+   std::string file_prefix;
+   int file_size_mb, queue_records;
+   nh.param<std::string>("imu_logger/file_prefix", file_prefix,
+                         std::string(home ? home : ".") + "/osu-uwrt/imu_mag_components"); //File path included in prefix
+   nh.param<int>("imu_logger/file_size_mb", file_size_mb, 64); //Files rotate at this size
+   nh.param<int>("imu_logger/queue_records", queue_records, 4096); //Samples buffered for the writer thread
 
-   //If unable to open for reading, then the file does not exist --> new file_name
-   while(!found_new_file_name) {
-     ROS_INFO("IMU Logger File Name:");
-     ROS_INFO("\t%s", file_name);
-     fid = fopen(file_name_c,"r");
-      if(fid) { //File already exists
-        //Increase num, and create new file name
-        num++;
-        file_suffix = boost::lexical_cast<std::string>(num);
-        file_name = strcat(convert(file_prefix),convert(file_suffix));
-        file_name = strcat(file_name,convert(file_type));
-        file_name_c = file_name;
-      }
-      else { //File does not exist
-        found_new_file_name = true;
-      }
-   }
+   logger.reset(new BinaryLogger(file_prefix, LOG_RECORD_MAG, sizeof(MagRecord), queue_records,
+                                 static_cast<size_t>(file_size_mb) << 20));
+   ROS_INFO("IMU Logger File Prefix:");
+   ROS_INFO("\t%s", file_prefix.c_str());
  }
 
-//Log magnetometer vector components
+//Log magnetometer vector components. Only queues the sample; the file is
+//written by the logger's own thread.
  void IMULogger::magLogger(const imu_3dm_gx4::MagFieldCF::ConstPtr& mag) {
+   monitor.wake();
 
-   //Open file and print values
-   fid = fopen(file_name_c,"a"); //Open file for "appending"
-   if(!fid) {
-     ROS_INFO("IMU Logger: file not opened");
-   }
-
-   if(!initialized) {
-     tStart = ros::Time::now().toSec();
-     fprintf(fid,"%f,", 0.0);
-     initialized = true;
-   } else {
-     tNow = ros::Time::now().toSec();
-     fprintf(fid,"%f,", tNow - tStart);
+   MagRecord record;
+   record.stamp = mag->header.stamp.toNSec();
+   record.x = mag->mag_field_components.x;
+   record.y = mag->mag_field_components.y;
+   record.z = mag->mag_field_components.z;
+   record.reserved = 0;
+   if(!logger->log(&record)) {
+     ROS_WARN_THROTTLE(5, "IMU Logger: queue full, %lu samples dropped", logger->dropped());
    }
-   fprintf(fid,"%f,", mag->mag_field_components.x);
-   fprintf(fid,"%f,", mag->mag_field_components.y);
-   fprintf(fid,"%f\n", mag->mag_field_components.z);
-   fclose(fid);
+   monitor.handled(mag->header.stamp);
  }
 
- //ROS loop function
+ //ROS loop function: everything runs from callbacks, so block until one is due
   void IMULogger::loop()
   {
-    ros::Rate rate(1000);
-    while (!ros::isShuttingDown())
-    {
-      ros::spinOnce();
-      rate.sleep();
-    }
+    ros::spin();
   }
@@ -1,18 +1,12 @@
 #include "riptide_hardware/imu_processor.h"
+#include <boost/make_shared.hpp>
 
  #define PI 3.141592653
  //using namespace imu_3dm_gx4;
  //using namespace message_filters;
 
- int main(int argc, char** argv)
- {
-   ros::init(argc, argv, "imu_processor");
-   IMUProcessor imu(argv);
-   imu.loop();
- }
-
 //Constructor
- IMUProcessor::IMUProcessor(char **argv) : nh()
+ IMUProcessor::IMUProcessor(char **argv) : nh(), monitor(nh, "imu_processor")
  {
 
    imu_filter_sub = nh.subscribe<imu_3dm_gx4::FilterOutput>("imu/filter", 1, &IMUProcessor::filterCallback, this);
@@ -26,25 +20,79 @@
    nh.param<double>("declination", declination, -6.838); //Default is Columbus declination
 
    zero_ang_vel_thresh = 1;
-   cycles = 1;
-   c = 3; //Index of center element in state array
-   size = 7; //Size of state array
+   heading = 0;
+   mag_pending = false;
+   loadFilter();
+
+   //IMU position from the center of mass, in vehicle axes (x forward, y left, z up).
+   //See cfg/sensor_to_vehicle_tf.yaml for how it follows from the URDF.
+   //The IMU is mounted upside down, so its body axes are the vehicle's as well.
+   ros::NodeHandle ipp("imu_processor");
+   ipp.param<double>("sensor_to_vehicle/lever_arm/x", lever_arm.x, 0.0);
+   ipp.param<double>("sensor_to_vehicle/lever_arm/y", lever_arm.y, 0.0);
+   ipp.param<double>("sensor_to_vehicle/lever_arm/z", lever_arm.z, 0.0);
  }
 
-//Read magnetometer data and compute heading
+//Read magnetometer data. The heading is computed against the roll and pitch
+//at the magnetometer's sample time, which may need the next filter sample.
 void IMUProcessor::magCallback(const imu_3dm_gx4::MagFieldCF::ConstPtr& mag_msg) {
+  monitor.wake();
+
   //Read in body frame mag components
   magBX = mag_msg->mag_field_components.x;
   magBY = mag_msg->mag_field_components.y;
   magBZ = mag_msg->mag_field_components.z;
+  mag_stamp = mag_msg->header.stamp;
+  mag_pending = true;
+
+  fuseMag();
+}
+
+//Wrap an angle to (-180, 180] deg
+static double wrap180(double a) {
+  while(a > 180.0) a -= 360.0;
+  while(a <= -180.0) a += 360.0;
+  return a;
+}
+
+//Filter roll and pitch at time t [rad], interpolated between the samples
+//either side of it. False if t is newer than the newest sample.
+bool IMUProcessor::tiltAt(const ros::Time &t, float &roll, float &pitch) {
+  if(history.size() == 0 || t > history[0].stamp) {
+    return false;
+  }
+
+  //Newest sample at or before t; the oldest if t is older than the history
+  unsigned i = 0;
+  while(i + 1 < history.size() && history[i].stamp > t) {
+    i++;
+  }
+  const ImuSample &before = history[i];
+  const ImuSample &after = history[i > 0 ? i-1 : 0];
+
+  double span = (after.stamp - before.stamp).toSec();
+  double f = span > 0 ? (t - before.stamp).toSec() / span : 0.0;
+  f = f < 0 ? 0 : f;
+  roll = wrap180(before.raw_euler_rpy.x + f*wrap180(after.raw_euler_rpy.x - before.raw_euler_rpy.x)) * PI/180;
+  pitch = (before.raw_euler_rpy.y + f*(after.raw_euler_rpy.y - before.raw_euler_rpy.y)) * PI/180;
+  return true;
+}
+
+//Compute the tilt-compensated heading of the pending magnetometer sample
+void IMUProcessor::fuseMag() {
+  float roll, pitch;
+  if(!mag_pending || !tiltAt(mag_stamp, roll, pitch)) {
+    return;
+  }
+  mag_pending = false;
 
   //Compute norm of body-frame mag vector
   //float mBX = 0.0, mBY = 0.0, mBZ = 0.0;
   norm(magBX, magBY, magBZ, &mBX, &mBY, &mBZ);
 
   //Calculate x and y mag components in world frame
-  mWX = mBX*cos(lastPitch) + mBY*sin(lastPitch)*sin(lastRoll) + mBZ*sin(lastPitch)*cos(lastRoll);
-  mWY = -mBY*cos(lastRoll) + mBZ*sin(lastRoll);
+  mWX = mBX*cos(pitch) + mBY*sin(pitch)*sin(roll) + mBZ*sin(pitch)*cos(roll);
+  mWY = -mBY*cos(roll) + mBZ*sin(roll);
 
   //Calculate heading with arctan (use atan2)
   heading = atan2(mWY, mWX) * 180/PI;
@@ -57,11 +105,14 @@ void IMUProcessor::magCallback(const imu_3dm_gx4::MagFieldCF::ConstPtr& mag_msg)
   else if(heading < -180.0) {
     heading += 360; //Add 360 deg.
   }
-  state[0].heading = heading;
 
-  //Set YAW equal to calculated heading
+  //Set YAW equal to calculated heading for the samples from the magnetometer's
+  //sample time on that are not yet published
   //Multiply by -1 (positive z-axis points up)
-  state[0].euler_rpy.z = -state[0].heading;
+  for(unsigned i = 0; i <= c && i < history.size() && history[i].stamp >= mag_stamp; i++) {
+    history[i].heading = heading;
+    history[i].euler_rpy.z = -heading;
+  }
 }
 
 void IMUProcessor::norm(float v1, float v2, float v3, float *x, float *y, float *z) {
@@ -71,180 +122,251 @@ void IMUProcessor::norm(float v1, float v2, float v3, float *x, float *y, float
   *z = v3/magnitude;
 }
 
- //Callback
-  void IMUProcessor::filterCallback(const imu_3dm_gx4::FilterOutput::ConstPtr& filter_msg)
-  {
-    //Put message data into state[0]
-    state[0].header = filter_msg->header;
-    state[0].header.frame_id = "base_link";
-
-    state[0].raw_euler_rpy = filter_msg->euler_rpy;
-    state[0].euler_rpy.x = filter_msg->euler_rpy.x;
-    state[0].euler_rpy.y = filter_msg->euler_rpy.y;
-    state[0].gyro_bias = filter_msg->gyro_bias;
-    state[0].euler_rpy_status = filter_msg->euler_rpy_status;
-
-    //DO NOT set euler_rpy.z here. This value is calculated by the magnetometer
-    //and is thus based on the magnetic field callback,
-
-    state[0].heading_update = filter_msg->heading_update;
-    state[0].heading_update_uncertainty = filter_msg->heading_update_uncertainty;
-    state[0].heading_update_source = filter_msg->heading_update_source;
-    state[0].heading_update_flags = filter_msg->heading_update_flags;
-
-    state[0].raw_linear_accel = filter_msg->linear_acceleration;
-    state[0].linear_accel = filter_msg->linear_acceleration;
-    state[0].linear_accel_status = filter_msg->linear_acceleration_status;
+// Vector3 to and from the history's plain vectors
+static ImuVector toVector(const geometry_msgs::Vector3 &v)
+{
+  ImuVector r = { v.x, v.y, v.z };
+  return r;
+}
 
-    state[0].raw_ang_v = filter_msg->angular_velocity;
-    state[0].ang_v = filter_msg->angular_velocity;
-    state[0].ang_v_status = filter_msg->angular_velocity_status;
+static geometry_msgs::Vector3 toMsg(const ImuVector &v)
+{
+  geometry_msgs::Vector3 r;
+  r.x = v.x;
+  r.y = v.y;
+  r.z = v.z;
+  return r;
+}
 
-    lastRoll = state[0].euler_rpy.x;
-    lastPitch = state[0].euler_rpy.y;
+//Callback
+void IMUProcessor::filterCallback(const imu_3dm_gx4::FilterOutput::ConstPtr& filter_msg)
+{
+  monitor.wake();
 
-    //Convert angular values from radians to degrees
-    cvtRad2Deg();
+  //Put message data into a new sample, history[0]
+  ImuSample &sample = history.push();
+  sample.seq = filter_msg->header.seq;
+  sample.stamp = filter_msg->header.stamp;
 
-    //Process Euler Angles (adjust heading and signs)
-    processEulerAngles();
+  sample.raw_euler_rpy = toVector(filter_msg->euler_rpy);
+  sample.euler_rpy.x = filter_msg->euler_rpy.x;
+  sample.euler_rpy.y = filter_msg->euler_rpy.y;
+  sample.gyro_bias = toVector(filter_msg->gyro_bias);
+  sample.euler_rpy_status = filter_msg->euler_rpy_status;
 
-    //Populate shorthand matrices for data smoothing
-    av[0][0] = state[0].raw_ang_v.x;
-    av[1][0] = state[0].raw_ang_v.y;
-    av[2][0] = state[0].raw_ang_v.z;
-    la[0][0] = state[0].raw_linear_accel.x;
-    la[1][0] = state[0].raw_linear_accel.y;
-    la[2][0] = state[0].raw_linear_accel.z;
+  //DO NOT take euler_rpy.z from the filter. This value is calculated by the magnetometer
+  //and is thus based on the magnetic field callback,
+  sample.heading = heading;
+  sample.euler_rpy.z = -heading;
 
-    //Further process data
-    if(cycles >= size) {
-      smoothData();
-    }
+  sample.heading_update = filter_msg->heading_update;
+  sample.heading_update_uncertainty = filter_msg->heading_update_uncertainty;
+  sample.heading_update_source = filter_msg->heading_update_source;
+  sample.heading_update_flags = filter_msg->heading_update_flags;
 
-    //Process linear acceleration (Remove centrifugal and tangential components)
+  sample.raw_linear_accel = toVector(filter_msg->linear_acceleration);
+  sample.linear_accel = sample.raw_linear_accel;
+  sample.linear_accel_status = filter_msg->linear_acceleration_status;
 
+  sample.raw_ang_v = toVector(filter_msg->angular_velocity);
+  sample.ang_v = sample.raw_ang_v;
+  sample.ang_v_status = filter_msg->angular_velocity_status;
+  sample.ang_accel.x = sample.ang_accel.y = sample.ang_accel.z = 0;
 
-    //Process angular acceleration (Use 3-pt backwards rule to approximate angular acceleration)
+  //Convert angular values from radians to degrees
+  cvtRad2Deg(sample);
 
+  //Process Euler Angles (adjust heading and signs)
+  processEulerAngles(sample);
 
-    //Must have completed 14 cycles because there need to be 7 smoothed data points
-    //before processing velocities, accelerations, etc.
-    if(cycles < 14) {
-      cycles += 1;
-    }
+  //Heading of a magnetometer sample that was waiting for this one
+  fuseMag();
 
-    //Publish messages
-    populateIMUState();
-    imu_verbose_state_pub.publish(state[c]);
-    imu_state_pub.publish(imu_state);
+  //Further process data
+  smoothData();
 
-    //Adjust previous states and shorthand matrices
-    for(int i=6; i>0; i--) {
-      state[i] = state[i-1];
+  //Process angular acceleration (Use 3-pt backwards rule to approximate angular acceleration)
+  //then linear acceleration (Remove centrifugal and tangential components). Both
+  //need the smoothed values of history[c] and the two samples before it.
+  if(history.size() > c + 2) {
+    processAngularAccel();
+    processLinearAccel();
+  }
 
-      for(int j=0; j<3; j++) {
-        av[j][i] = av[j][i-1];
-        la[j][i] = la[j][i-1];
-      }
-    }
+  //Publish messages, lined up with the smoothed values
+  if(history.size() > c) {
+    populateIMUState(history[c]);
+    //Fresh shared messages: in-process subscribers (control_replay) get them
+    //straight away, without serialization
+    imu_verbose_state_pub.publish(boost::make_shared<riptide_msgs::ImuVerbose>(verbose_state));
+    imu_state_pub.publish(boost::make_shared<riptide_msgs::Imu>(imu_state));
+    monitor.handled(history[c].stamp);
   }
+}
 
 //Convert all data fields from radians to degrees
-void IMUProcessor::cvtRad2Deg() {
-  state[0].raw_euler_rpy.x *= (180.0/PI);
-  state[0].raw_euler_rpy.y *= (180.0/PI);
-  state[0].raw_euler_rpy.z *= (180.0/PI);
-  state[0].euler_rpy.x *= (180.0/PI);
-  state[0].euler_rpy.y *= (180.0/PI);
-
-  state[0].gyro_bias.x *= (180.0/PI);
-  state[0].gyro_bias.y *= (180.0/PI);
-  state[0].gyro_bias.z *= (180.0/PI);
-
-  state[0].heading_update *= (180/PI);
-  state[0].heading_update_uncertainty *= (180/PI);
-
-  state[0].raw_ang_v.x *= (180.0/PI);
-  state[0].raw_ang_v.y *= (180.0/PI);
-  state[0].raw_ang_v.z *= (180.0/PI);
+void IMUProcessor::cvtRad2Deg(ImuSample &sample) {
+  sample.raw_euler_rpy.x *= (180.0/PI);
+  sample.raw_euler_rpy.y *= (180.0/PI);
+  sample.raw_euler_rpy.z *= (180.0/PI);
+  sample.euler_rpy.x *= (180.0/PI);
+  sample.euler_rpy.y *= (180.0/PI);
+
+  sample.gyro_bias.x *= (180.0/PI);
+  sample.gyro_bias.y *= (180.0/PI);
+  sample.gyro_bias.z *= (180.0/PI);
+
+  sample.heading_update *= (180/PI);
+  sample.heading_update_uncertainty *= (180/PI);
+
+  sample.raw_ang_v.x *= (180.0/PI);
+  sample.raw_ang_v.y *= (180.0/PI);
+  sample.raw_ang_v.z *= (180.0/PI);
 }
 
 //Adjust Euler angles to be consistent with the AUV's axes
-void IMUProcessor::processEulerAngles() {
+void IMUProcessor::processEulerAngles(ImuSample &sample) {
   //Adjust ROLL
-  if(state[0].euler_rpy.x > -180 && state[0].euler_rpy.x < 0) {
-    state[0].euler_rpy.x += 180;
+  if(sample.euler_rpy.x > -180 && sample.euler_rpy.x < 0) {
+    sample.euler_rpy.x += 180;
   }
-  else if(state[0].euler_rpy.x > 0 && state[0].euler_rpy.x < 180) {
-    state[0].euler_rpy.x -= 180;
+  else if(sample.euler_rpy.x > 0 && sample.euler_rpy.x < 180) {
+    sample.euler_rpy.x -= 180;
   }
-  else if(state[0].euler_rpy.x == 0) {
-    state[0].euler_rpy.x = 180;
+  else if(sample.euler_rpy.x == 0) {
+    sample.euler_rpy.x = 180;
   }
-  else if(state[0].euler_rpy.x == 180 || state[0].euler_rpy.x == -180) {
-    state[0].euler_rpy.x = 0;
+  else if(sample.euler_rpy.x == 180 || sample.euler_rpy.x == -180) {
+    sample.euler_rpy.x = 0;
   }
 
   //Adjust pitch (negate the value - positive y-axis points left)
-  state[0].euler_rpy.y *= -1;
-
-  //lastRoll = state[0].euler_rpy.x * PI/180;
-  //lastPitch = state[0].euler_rpy.y * PI/180;
+  sample.euler_rpy.y *= -1;
 
   //Reminder:
   //DO NOT adjust euler_rpy.z here. This value is calculated by the magnetometer
   //and is thus based on the magnetic field callback,
 }
 
-//Smooth Angular Velocity and Linear Acceleration with a Gaussian 7-point smooth
-//NOTE: Smoothed values are actually centered about the middle state within
-//the state array, state 4 (c = center = index 3)
+//Smoothing filter from the city yaml:
+//  filter/type: gaussian (default), fir, butterworth or none
+//  filter/taps: FIR taps, newest sample first
+//  filter/cutoff, filter/sample_rate: Butterworth cutoff and IMU filter rate [Hz]
+void IMUProcessor::loadFilter() {
+  ros::NodeHandle ipp("imu_processor");
+  std::string type;
+  ipp.param<std::string>("filter/type", type, "gaussian");
+
+  std::string error;
+  if(type == "gaussian" || type == "fir") {
+    //Gaussian 7-point smooth, centered 3 samples back
+    std::vector<double> taps = {1, 3, 6, 7, 6, 3, 1};
+    if(type == "fir" && !ipp.getParam("filter/taps", taps))
+      error = "no filter/taps";
+    else
+      error = filter.setFir(taps);
+  }
+  else if(type == "butterworth") {
+    double cutoff, sample_rate;
+    ipp.param<double>("filter/cutoff", cutoff, 10.0);
+    ipp.param<double>("filter/sample_rate", sample_rate, 100.0);
+    error = filter.setButterworth(cutoff, sample_rate);
+  }
+  else if(type != "none") {
+    error = "unknown filter/type " + type;
+  }
+
+  if(!error.empty()) {
+    ROS_ERROR("IMU filter: %s, not smoothing", error.c_str());
+    filter.setNone();
+  }
+  c = filter.getDelay();
+  ROS_INFO("IMU filter: %s, %u sample delay", error.empty() ? type.c_str() : "none", c);
+}
+
+//Smooth Angular Velocity and Linear Acceleration of the new sample. The
+//filtered values lag by the filter delay, so they are stored in history[c]
 void IMUProcessor::smoothData() {
-  int coef[size] = {1, 3, 6, 7, 6, 3, 1};
-  int sumCoef = 27;
-
-  //Set all desired values to smooth to 0
-  state[c].ang_v.x = 0;
-  state[c].ang_v.y = 0;
-  state[c].ang_v.z = 0;
-  state[c].linear_accel.x = 0;
-  state[c].linear_accel.y = 0;
-  state[c].linear_accel.z = 0;
-
-  //Smooth Data
-  //Reminder for using shorthand matrices:
-  //"av" = "Angular Velocity"
-  //"la" = "Linear Acceleration"
-  //row 0 = x-axis, row 1 = y-axis, row 2 = z-axis
-  //col 0 = state 0, col 1 = state 1, etc.
-  for(int i = 0; i<size; i++) {
-    state[c].ang_v.x += coef[i]*av[0][i]/sumCoef;
-    state[c].ang_v.y += coef[i]*av[1][i]/sumCoef;
-    state[c].ang_v.z += coef[i]*av[2][i]/sumCoef;
-
-    state[c].linear_accel.x += coef[i]*la[0][i]/sumCoef;
-    state[c].linear_accel.y += coef[i]*la[1][i]/sumCoef;
-    state[c].linear_accel.z += coef[i]*la[2][i]/sumCoef;
-  }
-}
-
-//Populate imu_state message
-void IMUProcessor::populateIMUState() {
-  imu_state.header = state[c].header;
-  imu_state.euler_rpy = state[c].euler_rpy;
-  imu_state.linear_accel = state[c].linear_accel;
-  imu_state.ang_v = state[c].ang_v;
-  imu_state.ang_accel = state[c].ang_accel;
-}
-
-//ROS loop function
- void IMUProcessor::loop()
- {
-   ros::Rate rate(1000);
-   while (!ros::isShuttingDown())
-   {
-     ros::spinOnce();
-     rate.sleep();
-   }
- }
+  const ImuSample &s = history[0];
+  double x[IMU_CHANNELS] = { s.raw_ang_v.x, s.raw_ang_v.y, s.raw_ang_v.z,
+                             s.raw_linear_accel.x, s.raw_linear_accel.y, s.raw_linear_accel.z };
+  filter.apply(x);
+
+  if(history.size() > c) {
+    ImuSample &smoothed = history[c];
+    smoothed.ang_v.x = x[0];
+    smoothed.ang_v.y = x[1];
+    smoothed.ang_v.z = x[2];
+    smoothed.linear_accel.x = x[3];
+    smoothed.linear_accel.y = x[4];
+    smoothed.linear_accel.z = x[5];
+  }
+}
+
+//Angular acceleration of history[c] from its smoothed angular velocity and
+//that of the two samples before it [deg/s^2]
+void IMUProcessor::processAngularAccel() {
+  ImuSample &s0 = history[c];
+  const ImuSample &s1 = history[c+1];
+  const ImuSample &s2 = history[c+2];
+
+  //Average step over the three samples
+  double dt = (s0.stamp - s2.stamp).toSec() / 2;
+  if(dt <= 0) {
+    return;
+  }
+  s0.ang_accel.x = (3*s0.ang_v.x - 4*s1.ang_v.x + s2.ang_v.x) / (2*dt);
+  s0.ang_accel.y = (3*s0.ang_v.y - 4*s1.ang_v.y + s2.ang_v.y) / (2*dt);
+  s0.ang_accel.z = (3*s0.ang_v.z - 4*s1.ang_v.z + s2.ang_v.z) / (2*dt);
+}
+
+//Move the linear acceleration of history[c] from the IMU to the center of mass:
+//  a_cm = a_imu - alpha x r - w x (w x r)
+//where r is the lever arm, alpha x r the tangential and w x (w x r) the
+//centripetal component
+void IMUProcessor::processLinearAccel() {
+  ImuSample &s = history[c];
+  const ImuVector &r = lever_arm;
+  ImuVector w = { s.ang_v.x*PI/180, s.ang_v.y*PI/180, s.ang_v.z*PI/180 };
+  ImuVector alpha = { s.ang_accel.x*PI/180, s.ang_accel.y*PI/180, s.ang_accel.z*PI/180 };
+
+  ImuVector wr = { w.y*r.z - w.z*r.y, w.z*r.x - w.x*r.z, w.x*r.y - w.y*r.x };
+  s.linear_accel.x -= (alpha.y*r.z - alpha.z*r.y) + (w.y*wr.z - w.z*wr.y);
+  s.linear_accel.y -= (alpha.z*r.x - alpha.x*r.z) + (w.z*wr.x - w.x*wr.z);
+  s.linear_accel.z -= (alpha.x*r.y - alpha.y*r.x) + (w.x*wr.y - w.y*wr.x);
+}
+
+//Populate imu_verbose_state and imu_state messages
+void IMUProcessor::populateIMUState(const ImuSample &sample) {
+  verbose_state.header.seq = sample.seq;
+  verbose_state.header.stamp = sample.stamp;
+  verbose_state.header.frame_id = "base_link";
+  verbose_state.raw_euler_rpy = toMsg(sample.raw_euler_rpy);
+  verbose_state.euler_rpy = toMsg(sample.euler_rpy);
+  verbose_state.gyro_bias = toMsg(sample.gyro_bias);
+  verbose_state.heading = sample.heading;
+  verbose_state.heading_update = sample.heading_update;
+  verbose_state.heading_update_uncertainty = sample.heading_update_uncertainty;
+  verbose_state.heading_update_source = sample.heading_update_source;
+  verbose_state.heading_update_flags = sample.heading_update_flags;
+  verbose_state.raw_linear_accel = toMsg(sample.raw_linear_accel);
+  verbose_state.linear_accel = toMsg(sample.linear_accel);
+  verbose_state.raw_ang_v = toMsg(sample.raw_ang_v);
+  verbose_state.ang_v = toMsg(sample.ang_v);
+  verbose_state.ang_accel = toMsg(sample.ang_accel);
+  verbose_state.euler_rpy_status = sample.euler_rpy_status;
+  verbose_state.ang_v_status = sample.ang_v_status;
+  verbose_state.linear_accel_status = sample.linear_accel_status;
+
+  imu_state.header = verbose_state.header;
+  imu_state.euler_rpy = verbose_state.euler_rpy;
+  imu_state.linear_accel = verbose_state.linear_accel;
+  imu_state.ang_v = verbose_state.ang_v;
+  imu_state.ang_accel = verbose_state.ang_accel;
+}
+
+//ROS loop function: everything runs from callbacks, so block until one is due
+void IMUProcessor::loop()
+{
+  ros::spin();
+}
@@ -0,0 +1,8 @@
+#include "riptide_hardware/imu_processor.h"
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "imu_processor");
+  IMUProcessor imu(argv);
+  imu.loop();
+}
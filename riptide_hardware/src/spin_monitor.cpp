@@ -0,0 +1,75 @@
+#include "riptide_hardware/spin_monitor.h"
+
+#include <sys/resource.h>
+#include <algorithm>
+
+// Voluntary context switches of the calling thread: how often it blocked and
+// was woken again
+static long contextSwitches()
+{
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) != 0)
+    return 0;
+  return usage.ru_nvcsw;
+}
+
+SpinMonitor::SpinMonitor(ros::NodeHandle &nh, const std::string &name)
+  : name(name), callbacks(0), samples(0), latency_sum(0), latency_max(0), last_switches(-1)
+{
+  diag_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+  timer = nh.createWallTimer(ros::WallDuration(1.0), &SpinMonitor::report, this);
+  last_report = ros::WallTime::now();
+}
+
+void SpinMonitor::handled(const ros::Time &stamp)
+{
+  double latency = (ros::Time::now() - stamp).toSec();
+  samples++;
+  latency_sum += latency;
+  latency_max = std::max(latency_max, latency);
+}
+
+void SpinMonitor::report(const ros::WallTimerEvent &event)
+{
+  // The timer runs on the spinning thread, so this counts its wake-ups
+  long switches = contextSwitches();
+  double window = (event.current_real - last_report).toSec();
+  last_report = event.current_real;
+  if (last_switches < 0 || window <= 0)
+  {
+    // First report: only start counting
+    last_switches = switches;
+    callbacks = samples = 0;
+    latency_sum = latency_max = 0;
+    return;
+  }
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = name + ": spin";
+  status.hardware_id = name;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "event driven";
+
+  std::vector<std::pair<std::string, double> > values;
+  values.push_back(std::make_pair("wake-ups [1/s]", (switches - last_switches) / window));
+  values.push_back(std::make_pair("callbacks [1/s]", callbacks / window));
+  values.push_back(std::make_pair("samples", samples));
+  values.push_back(std::make_pair("latency mean [ms]", samples ? 1e3 * latency_sum / samples : 0.0));
+  values.push_back(std::make_pair("latency max [ms]", 1e3 * latency_max));
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = values[i].first;
+    kv.value = std::to_string(values[i].second);
+    status.values.push_back(kv);
+  }
+
+  diagnostic_msgs::DiagnosticArray diag;
+  diag.header.stamp = ros::Time::now();
+  diag.status.push_back(status);
+  diag_pub.publish(diag);
+
+  last_switches = switches;
+  callbacks = samples = 0;
+  latency_sum = latency_max = 0;
+}